@@ -0,0 +1,249 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : clock.c                                                         *
+ * Synopsis : Kernel time keeping and timers. In periodic mode the systick    *
+ *            interrupts every tick. Build with TICKLESS defined and the      *
+ *            systick is only programmed to interrupt when the kernel has     *
+ *            something to do.                                                *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <tm4c123gh6pm.h>
+#include <types.h>
+#include <hw.h>
+#include <proc.h> /* For timesliced() and wakeproc() */
+#include <clock.h>
+
+word ticks;
+int slice;
+word suppressed;
+/* Number of ticks the current systick period covers. */
+static word period;
+/* Hashed timer wheel. A process waiting for tick t is kept in the list at */
+/* wheel[t % WHEEL_SIZE], so adding and expiring a timer never needs a search.*/
+static struct pcb *wheel[WHEEL_SIZE];
+/* Number of processes in the timer wheel. */
+static int ntimers;
+#ifdef TICKLESS
+/* Ticks of the current period that have already been added to ticks. */
+static word synced;
+/* Cycles of a tick that had passed when the systick was last reprogrammed. */
+static word carry;
+/* Tick of the earliest timer, valid only when nextvalid is 1. */
+static word nexttimer;
+static int nextvalid;
+#endif
+
+/*
+ * Initialize the kernel clock and start the systick.
+ */
+void init_clock() {
+/* Globals are not initialized at reset. */
+	ticks = 0;
+	slice = TIMESLICE;
+	suppressed = 0;
+	period = 1;
+	for(int i = 0; i < WHEEL_SIZE; i++) {
+		wheel[i] = NULL;
+	}
+	ntimers = 0;
+#ifdef TICKLESS
+	synced = 0;
+	carry = 0;
+	nextvalid = 0;
+#endif
+	start_clocktick(TICK_CYCLES);
+}
+
+/*
+ * Put a process in the timer wheel so that it is woken up timeout ticks from
+ * now. Takes constant time.
+ */
+void timer_add(struct pcb *p, word timeout) {
+	struct pcb **bucket;
+#ifdef TICKLESS
+	clock_sync();
+#endif
+	p->timed = 1;
+	p->wakeat = ticks + timeout;
+	bucket = &wheel[p->wakeat & (WHEEL_SIZE - 1)];
+	p->tprev = NULL;
+	p->tnext = *bucket;
+	if(NULL != *bucket) {
+		(*bucket)->tprev = p;
+	}
+	*bucket = p;
+	ntimers++;
+#ifdef TICKLESS
+	if(!nextvalid || (int)(p->wakeat - nexttimer) < 0) {
+		nexttimer = p->wakeat;
+		nextvalid = 1;
+	}
+#endif
+}
+
+/*
+ * Take a process out of the timer wheel. Takes constant time.
+ */
+void timer_del(struct pcb *p) {
+	if(NULL != p->tprev) {
+		p->tprev->tnext = p->tnext;
+	}
+	else {
+		wheel[p->wakeat & (WHEEL_SIZE - 1)] = p->tnext;
+	}
+	if(NULL != p->tnext) {
+		p->tnext->tprev = p->tprev;
+	}
+	p->tnext = p->tprev = NULL;
+	p->timed = 0;
+	ntimers--;
+#ifdef TICKLESS
+/* Found again by timer_next() if it was the earliest. */
+	if(nextvalid && p->wakeat == nexttimer) {
+		nextvalid = 0;
+	}
+#endif
+}
+
+/*
+ * Wake up the processes in the bucket for tick t whose time has come. Timers
+ * for later turns of the wheel are left where they are. A process that is
+ * still in a wait queue has timed out.
+ */
+static void timer_expire(word t) {
+	struct pcb *p = wheel[t & (WHEEL_SIZE - 1)];
+	struct pcb *next;
+	while(NULL != p) {
+		next = p->tnext;
+		if((int)(p->wakeat - ticks) <= 0) {
+			if(NULL != p->waitq) {
+				setreturn(p, TIMEDOUT);
+			}
+			wakeproc(p);
+		}
+		p = next;
+	}
+}
+
+/*
+ * Move the clock forward n ticks and wake up any sleeping processes that are
+ * due. When n is 1 only the bucket for the current tick is looked at.
+ */
+static void advance(word n) {
+	word t = ticks;
+/* One turn of the wheel sees every timer, however many ticks passed. */
+	word buckets = n < WHEEL_SIZE ? n : WHEEL_SIZE;
+	ticks += n;
+	slice -= n;
+	while(0 != ntimers && buckets-- > 0) {
+		timer_expire(++t);
+	}
+}
+
+/*
+ * Account for the ticks that have passed since the last systick interrupt.
+ * Must be called from the systick interrupt.
+ */
+void clock_tick() {
+#ifdef TICKLESS
+	suppressed += period - 1;
+	advance(period - synced);
+	synced = 0;
+	carry = 0;
+#else
+	advance(1);
+#endif
+}
+
+#ifdef TICKLESS
+/*
+ * Bring ticks up to date with the time that has passed in the current
+ * systick period. In tickless mode ticks is otherwise only updated when the
+ * systick interrupts.
+ */
+void clock_sync() {
+	word n;
+/* A tick that is pending but not yet taken is counted first, since the */
+/* counter has already started the next period. */
+	if(NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET) {
+		NVIC_INT_CTRL_R = NVIC_INT_CTRL_PENDSTCLR;
+		clock_tick();
+	}
+	n = (elapsed_clocktick() + carry) / TICK_CYCLES - synced;
+	advance(n);
+	synced += n;
+}
+
+/*
+ * Returns the number of ticks until the earliest timer expires, or 0 if there
+ * are no timers. Only has to search the wheel when the earliest timer has
+ * been taken out since the last search.
+ */
+static word timer_next() {
+	struct pcb *p;
+	word t;
+	if(0 == ntimers) {
+		return 0;
+	}
+/* The first bucket with a timer due on this turn of the wheel has the */
+/* earliest timer. */
+	if(!nextvalid) {
+		for(t = ticks + 1; t != ticks + 1 + WHEEL_SIZE && !nextvalid; t++) {
+			for(p = wheel[t & (WHEEL_SIZE - 1)]; NULL != p; p = p->tnext) {
+				if((int)(p->wakeat - t) <= 0) {
+					nexttimer = t;
+					nextvalid = 1;
+					break;
+				}
+			}
+		}
+	}
+/* Everything is on a later turn of the wheel. Look again in one turn. */
+	if(!nextvalid) {
+		return WHEEL_SIZE;
+	}
+	if((int)(nexttimer - ticks) <= 0) {
+		return 1;
+	}
+	return nexttimer - ticks;
+}
+
+/*
+ * Program the systick to interrupt the next time the kernel needs to run.
+ * That is when the earliest sleeping process wakes up, or when the time slice
+ * of the running process is used up if it is sharing the cpu, otherwise as
+ * late as the systick can count. Must be called whenever the set of ready or
+ * sleeping processes changes.
+ */
+void clock_arm() {
+	word deadline, timer, now;
+	clock_sync();
+	now = ticks;
+	timer = timer_next();
+/* The systick may have run out while the wheel was searched. Take that tick */
+/* now, with only arithmetic left before the reload. Once the counter is */
+/* reloaded, the pending interrupt would credit the whole new period. */
+	clock_sync();
+	if(timesliced()) {
+		deadline = slice > 0 ? slice : 1;
+	}
+	else {
+		deadline = MAX_TICKS;
+	}
+	if(0 != timer) {
+		timer = timer > ticks - now ? timer - (ticks - now) : 1;
+		if(timer < deadline) {
+			deadline = timer;
+		}
+	}
+	if(deadline > MAX_TICKS) {
+		deadline = MAX_TICKS;
+	}
+/* Carry the part of a tick that has passed over to the new period so that */
+/* the clock doesn't drift. */
+	carry = (elapsed_clocktick() + carry) % TICK_CYCLES;
+	synced = 0;
+	period = deadline;
+	reload_clocktick(deadline*TICK_CYCLES - carry);
+}
+#endif
@@ -4,54 +4,131 @@
  *Synopsis: Context switching and processor privledge control                 *
  *Date    : June 25th, 2019                                                   *
  *****************************************************************************/
-	
+
   .syntax unified
   .thumb
 
 /*
- * Context switcher. Load the registers from the process that is running.
- * Registers from the previous process are saved at the systick interrupt
- * before the cpu is switched to privledged and the stack pointer is switched
- * to msp.
- * void swtch(word sp), where sp is the top of the stack of the process to
- * switch to.
+ * Context switcher. This is the PendSV exception handler. The kernel never
+ * switches processes anywhere else, it only sets PendSV pending. PendSV has
+ * the lowest priority, so it runs once every other exception is done and
+ * tail chains into the running process's exception return.
+ * The processor has already stacked r0-r3, r12, lr, pc and xpsr (and s0-s15
+ * if the fpu was in use) on the process stack. swtch pushes the rest (a
+ * struct context, see proc.h) below them and gives that stack pointer to
+ * scheduler(), which returns the stack pointer of the context to switch to.
+ * A psp of 0 means there is no process to save, which is only true before
+ * the first process runs.
  */
   .global swtch
   .type swtch, %function
 swtch: .fnstart
-        msr psp, r0 //Switch psp stack to new one
-/* Switch to psp and unprivledge mode. */
-        mrs r2, CONTROL
-        orr r2, r2, #0x3
-        msr CONTROL, r2
-        pop {r0-r3, r5, r7, r12, r14}
-        bx r5
+.ifdef SWTCH_STATS
+        ldr r1, =0xE0001004 //DWT_CYCCNT
+        ldr r1, [r1]
+        ldr r2, =swtchstart
+        str r1, [r2]
+.endif
+        mrs r0, psp
+        cbz r0, Pick
+/* Bit 4 of EXC_RETURN is clear when the fpu registers were stacked too. */
+        tst lr, #0x10
+        it eq
+        vstmdbeq r0!, {s16-s31}
+        stmdb r0!, {r4-r11, lr}
+Pick:
+/* SysTick and other interrupts can change the ready queues. */
+        cpsid i
+        bl scheduler
+        ldmia r0!, {r4-r11, lr}
+        tst lr, #0x10
+        it eq
+        vldmiaeq r0!, {s16-s31}
+        msr psp, r0
+/* Processes run unprivileged. The exception return switches to psp. */
+        mrs r1, CONTROL
+        orr r1, r1, #0x1
+        msr CONTROL, r1
+        isb
+.ifdef SWTCH_STATS
+        ldr r1, =0xE0001004 //DWT_CYCCNT
+        ldr r1, [r1]
+        ldr r2, =swtchstart
+        ldr r3, [r2]
+        sub r1, r1, r3
+        ldr r2, =swtchcycles
+        str r1, [r2]
+.endif
+        cpsie i
+        bx lr
        .fnend
 
 /*
- * All new processes run initcode first to set up cpu registers to make it
- * look as if the process had been interrupted by an svc with it's registers
- * pushed on the stack. initcode places the value of pc into the r5 register.
- * initcode(struct pcb *), where the struct pcb pointer is the pointer of the
- * pcb struct to be context switched to.
+ * Set psp to 0 so that swtch() doesn't save the current process. Used when
+ * the process is killed because its stack can't be trusted. Must be followed
+ * by a switch to another process before returning to thread mode.
+ */
+  .global forget_psp
+  .type forget_psp, %function
+forget_psp: .fnstart
+        mov r0, #0
+        msr psp, r0
+        bx lr
+      .fnend
+
+/*
+ * Data memory barrier. Memory accesses before the call are done before any
+ * after it, as seen by interrupt handlers, other processes and the
+ * compiler. Runs in thread mode too.
+ */
+  .global barrier
+  .type barrier, %function
+barrier: .fnstart
+        dmb
+        bx lr
+      .fnend
+
+/*
+ * int cas(volatile word *addr, word old, word new)
+ * Store new at addr if addr holds old, in one atomic step. Returns 1 if it
+ * did, 0 if addr held something else. The exclusive monitor is cleared on
+ * every exception entry and return, so if anything else ran between the
+ * ldrex and the strex the strex fails and it tries again. The barriers make
+ * it safe to use for locks. Runs in thread mode too.
+ */
+  .global cas
+  .type cas, %function
+cas: .fnstart
+        dmb
+Retry:
+        ldrex r3, [r0]
+        cmp r3, r1
+        bne Fail
+        strex r3, r2, [r0]
+        cmp r3, #0
+        bne Retry
+        dmb
+        mov r0, #1
+        bx lr
+Fail:
+        clrex
+        mov r0, #0
+        bx lr
+      .fnend
+
+/*
+ * Sleep until an interrupt is pending, then let it run. Must be called with
+ * interrupts disabled so that an interrupt can not be taken between checking
+ * for something to do and going to sleep. wfi still wakes up for interrupts
+ * that are disabled.
  */
-  .global initcode
-  .type initcode, %function
-initcode: .fnstart
-          add r1, r0, #4
-          ldr r2, [r1] //context.pc
-          ldr r3, [r0] //context.sp
-//Move pc to r5's spot on the stack so it gets branched to in swtch()
-          str r2, [r3, #16]
-          add r1, r0, #12
-          ldr r2, [r1] //context.r0
-//store context.r0 on the stack in r0's spot
-          str r2, [r3]
-          add r1, r0, #20
-          ldr r2, [r1] //context.r7
-//store context.r7 on the stack in r7's spot
-          str r2, [r3, #20]
-          bx lr
-          .fnend	
+  .global idle
+  .type idle, %function
+idle: .fnstart
+        wfi
+        cpsie i
+        isb
+        cpsid i
+        bx lr
+      .fnend
 	.end
-	
@@ -0,0 +1,258 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : file.c                                                          *
+ * Synopsis : File descriptors and pipes                                      *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <types.h>
+#include <proc.h>
+#include <mem.h> /* For kmalloc() */
+#include <cstring.h> /* For memcpy() */
+#include <file.h>
+
+/* The smaller of a and b. */
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+/* Returns the open file for fd of the current process, or NULL. */
+static struct file *fdfile(int fd) {
+	if(fd < 0 || fd >= NFD) {
+		return NULL;
+	}
+	return currproc()->ofile[fd];
+}
+
+/* Returns the lowest free file descriptor of p, or -1 if it has none. */
+static int fdalloc(struct pcb *p) {
+	int fd;
+	for(fd = 0; fd < NFD; fd++) {
+		if(NULL == p->ofile[fd]) {
+			return fd;
+		}
+	}
+	return -1;
+}
+
+/* Returns an open file of type for pipe, or NULL if there is no space. */
+static struct file *filealloc(enum filetype type, struct pipe *pipe) {
+	struct file *f = kmalloc(sizeof(struct file));
+	if(NULL != f) {
+		f->type = type;
+		f->refs = 1;
+		f->pipe = pipe;
+	}
+	return f;
+}
+
+/*
+ * Create a pipe. fds[0] is set to a file descriptor for its read end and
+ * fds[1] to one for its write end. Returns 0 on success, or -1 if there is
+ * no space, the caller has no free file descriptors or fds isn't in its
+ * memory.
+ */
+int syspipe(int *fds) {
+	struct pcb *p = currproc();
+	struct pipe *pipe;
+	struct file *rf = NULL, *wf = NULL;
+	int rfd, wfd;
+	if(!checkuser(p, (word)fds, 2*sizeof(int)) ||
+	   NULL == (pipe = kmalloc(sizeof(struct pipe)))) {
+		return -1;
+	}
+	if(NULL == (pipe->buf = kmalloc(PIPE_SIZE)) ||
+	   NULL == (rf = filealloc(FD_PIPEREAD, pipe)) ||
+	   NULL == (wf = filealloc(FD_PIPEWRITE, pipe)) ||
+	   -1 == (rfd = fdalloc(p))) {
+		goto fail;
+	}
+	p->ofile[rfd] = rf;
+	if(-1 == (wfd = fdalloc(p))) {
+		p->ofile[rfd] = NULL;
+		goto fail;
+	}
+	p->ofile[wfd] = wf;
+	pipe->head = pipe->count = 0;
+	pipe->nreaders = pipe->nwriters = 1;
+	pipe->readq.head = pipe->writeq.head = NULL;
+	fds[0] = rfd;
+	fds[1] = wfd;
+	return 0;
+fail:
+	if(NULL != wf) {
+		kfree(wf, sizeof(struct file));
+	}
+	if(NULL != rf) {
+		kfree(rf, sizeof(struct file));
+	}
+	if(NULL != pipe->buf) {
+		kfree(pipe->buf, PIPE_SIZE);
+	}
+	kfree(pipe, sizeof(struct pipe));
+	return -1;
+}
+
+/* Copy n bytes from buf to the end of pipe, which must have room for them. */
+static void pipeput(struct pipe *pipe, char *buf, word n) {
+	word tail = (pipe->head + pipe->count) % PIPE_SIZE;
+	word first = min(n, PIPE_SIZE - tail);
+	memcpy(pipe->buf + tail, buf, first);
+	memcpy(pipe->buf, buf + first, n - first);
+	pipe->count += n;
+}
+
+/* Copy n bytes from the front of pipe, which must have them, to buf. */
+static void pipeget(struct pipe *pipe, char *buf, word n) {
+	word first = min(n, PIPE_SIZE - pipe->head);
+	memcpy(buf, pipe->buf + pipe->head, first);
+	memcpy(buf + first, pipe->buf, n - first);
+	pipe->head = (pipe->head + n) % PIPE_SIZE;
+	pipe->count -= n;
+}
+
+/*
+ * Read up to size bytes from fd into buf, blocking until there is at least
+ * one. Returns the number of bytes read, 0 at the end of a pipe that has no
+ * writers left, or -1 if fd isn't open for reading or buf isn't in the
+ * caller's memory.
+ */
+int sysread(int fd, void *buf, word size) {
+	struct file *f = fdfile(fd);
+	struct pipe *pipe;
+	struct pcb *w;
+	word n, got;
+	if(NULL == f || FD_PIPEREAD != f->type ||
+	   !checkuser(currproc(), (word)buf, size)) {
+		return -1;
+	}
+	pipe = f->pipe;
+	if(0 == size) {
+		return 0;
+	}
+	if(0 == pipe->count) {
+		if(0 == pipe->nwriters) {
+			return 0;
+		}
+/* syswrite() copies straight into buf and sets the return value. */
+		currproc()->ipcbuf = (word)buf;
+		currproc()->ipcsize = size;
+		sleepon(&pipe->readq, BLOCKED);
+		return 0;
+	}
+	got = min(size, pipe->count);
+	pipeget(pipe, buf, got);
+/* Fill the room that was made from writers that were waiting for it. */
+	while(pipe->count < PIPE_SIZE && NULL != (w = wakeone(&pipe->writeq))) {
+		n = min(w->ipcsize, PIPE_SIZE - pipe->count);
+		pipeput(pipe, (char *)w->ipcbuf, n);
+		setreturn(w, n);
+	}
+	return got;
+}
+
+/*
+ * Write up to size bytes from buf to fd. Only blocks when the pipe is full,
+ * until a reader makes room, so it returns as soon as some of the bytes are
+ * written. Returns the number of bytes written, or -1 if fd isn't open for
+ * writing, buf isn't in the caller's memory or the pipe has no readers left.
+ */
+int syswrite(int fd, void *buf, word size) {
+	struct file *f = fdfile(fd);
+	struct pipe *pipe;
+	struct pcb *r;
+	word n, put = 0;
+	if(NULL == f || FD_PIPEWRITE != f->type ||
+	   !checkuser(currproc(), (word)buf, size)) {
+		return -1;
+	}
+	pipe = f->pipe;
+	if(0 == pipe->nreaders) {
+		return -1;
+	}
+/* Readers only wait when the pipe is empty, so they get the bytes first. */
+	while(put < size && NULL != (r = wakeone(&pipe->readq))) {
+		n = min(size - put, r->ipcsize);
+		memcpy((void *)r->ipcbuf, (char *)buf + put, n);
+		setreturn(r, n);
+		put += n;
+	}
+	n = min(size - put, PIPE_SIZE - pipe->count);
+	pipeput(pipe, (char *)buf + put, n);
+	put += n;
+	if(0 != put || 0 == size) {
+		return put;
+	}
+/* sysread() takes what fits when it makes room and sets the return value. */
+	currproc()->ipcbuf = (word)buf;
+	currproc()->ipcsize = size;
+	sleepon(&pipe->writeq, BLOCKED);
+	return -1;
+}
+
+/* Wake up every process in q with ret as the return value. */
+static void wakeall(struct waitq *q, int ret) {
+	struct pcb *p;
+	while(NULL != (p = wakeone(q))) {
+		setreturn(p, ret);
+	}
+}
+
+/*
+ * Drop a reference to f. When the last one is gone the end of the pipe it
+ * belongs to is closed. Readers waiting on a pipe with no writers left get
+ * 0 for the end of the pipe and writers waiting on one with no readers left
+ * get -1. The pipe is freed once both ends are closed.
+ */
+static void fileclose(struct file *f) {
+	struct pipe *pipe = f->pipe;
+	if(--f->refs > 0) {
+		return;
+	}
+	if(FD_PIPEREAD == f->type && 0 == --pipe->nreaders) {
+		wakeall(&pipe->writeq, -1);
+	}
+	else if(FD_PIPEWRITE == f->type && 0 == --pipe->nwriters) {
+		wakeall(&pipe->readq, 0);
+	}
+	if(0 == pipe->nreaders && 0 == pipe->nwriters) {
+		kfree(pipe->buf, PIPE_SIZE);
+		kfree(pipe, sizeof(struct pipe));
+	}
+	kfree(f, sizeof(struct file));
+}
+
+/*
+ * Close fd. Returns 0 on success, or -1 if it isn't open.
+ */
+int sysclose(int fd) {
+	struct file *f = fdfile(fd);
+	if(NULL == f) {
+		return -1;
+	}
+	currproc()->ofile[fd] = NULL;
+	fileclose(f);
+	return 0;
+}
+
+/*
+ * Give child the same open files as parent.
+ */
+void file_fork(struct pcb *parent, struct pcb *child) {
+	int fd;
+	for(fd = 0; fd < NFD; fd++) {
+		if(NULL != (child->ofile[fd] = parent->ofile[fd])) {
+			child->ofile[fd]->refs++;
+		}
+	}
+}
+
+/*
+ * Close the open files of p, since it is exiting.
+ */
+void file_exit(struct pcb *p) {
+	int fd;
+	for(fd = 0; fd < NFD; fd++) {
+		if(NULL != p->ofile[fd]) {
+			fileclose(p->ofile[fd]);
+			p->ofile[fd] = NULL;
+		}
+	}
+}
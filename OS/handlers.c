@@ -9,22 +9,14 @@
 #include <kernel_services.h> /* Syscalls for svc_handler. */
 #include <proc.h> /* In systick interrupt, For scheduler() */
 #include <cstring.h> /* For printf() */
+#include <clock.h> /* For clock_tick() */
+#include <mem.h> /* For stackguard() */
+#include <ipc.h> /* Message queues for svc_handler. */
+#include <sync.h> /* Semaphores and mutexes for svc_handler. */
+#include <file.h> /* Pipes for svc_handler. */
 
 /* From vectors.s */
 extern void processor_state(int);
-extern void kernel_entry(struct pcb *);
-/* From context.s */
-extern void swtch(word sp);
-/* Function prototypes. */
-void syst_handler(word) __attribute__((noreturn, naked));
-
-/*
- * Puts the return value from system calls into the processes context.
- */
-static void syscreturn(word val) {
-	struct pcb *userproc = currproc();
-	userproc->context.r0 = val;
-}
 
 void nmi_handler() {
 	while(1);
@@ -40,9 +32,47 @@ void hfault_handler() {
   NVIC_HFAULT_STAT_R |= 0xFFFFFFFF;
 	while(1);
 }
-/* Memory Management Handler. */
-void mm_handler() {
-	while(1);
+/* From context.s */
+extern void forget_psp(void);
+
+/*
+ * Memory Management Handler. A process that touched memory outside of its
+ * MPU regions, like the guard at the bottom of its stack, is killed and the
+ * rest carry on. A fault in the kernel hangs.
+ * @param excreturn
+ *   EXC_RETURN. Bit 2 is set when the fault came from a process.
+ */
+void mm_handler(word excreturn) {
+	word stat = NVIC_FAULT_STAT_R & 0xFF;
+	word addr = NVIC_MM_ADDR_R;
+	struct pcb *p = currproc();
+/* Clear the memory management fault status bits. */
+	NVIC_FAULT_STAT_R = stat;
+	if(!(excreturn & 0x4)) {
+		printf("Memory fault in the kernel\n\r");
+		while(1);
+	}
+	printf("Process %d killed: ", p->pid);
+	if(stat & (NVIC_FAULT_STAT_MSTKE | NVIC_FAULT_STAT_MLSPERR) ||
+	   (stat & NVIC_FAULT_STAT_MMARV && addr >= p->stack &&
+	    addr < p->stack + stackguard(p))) {
+		printf("stack overflow\n\r");
+	}
+	else if(stat & NVIC_FAULT_STAT_MMARV) {
+		printf("access to %x\n\r", addr);
+	}
+	else {
+		printf("memory fault\n\r");
+	}
+	sysexit(EXIT_FAILURE);
+/* Its stack can't be trusted, so swtch() must not save anything to it, and */
+/* fpu registers that haven't been stacked yet are dropped. */
+	forget_psp();
+	NVIC_FPCC_R &= ~NVIC_FPCC_LSPACT;
+	NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
+#ifdef TICKLESS
+	clock_arm();
+#endif
 }
 /* 
  * Bus Fault Handler. Code that generates a bus fault usually exhibits
@@ -116,41 +146,108 @@ void u_handler(int stack) {
   while(1);
 }
 /* Supervisor Call (syscall) Handler. Acts as the OS Dispatcher. All SVC end */
-/* up here, and then it's decided how to handle it based on the sysnum. */
-void svc_handler(int sysnum, void *arg1, void *arg2, void *arg3) {
+/* up here, and then it's decided how to handle it based on the sysnum. The */
+/* sysnum and arguments are in r0-r3 of the trapframe, and the return value */
+/* goes back in r0. ctx holds the rest of the callers registers for fork. */
+void svc_handler(struct trapframe *tf, struct context *ctx) {
 /* Return values from system calls. */
 	word ret;
-	switch(sysnum) {
-		case 0: ret = sysfork();
+	switch(tf->r0) {
+		case 0: ret = sysfork(tf, ctx);
 						break;
-		case 1: ret = syswait(*((word *)arg1));
+		case 1: ret = syswait(tf->r1, (int *)tf->r2);
 						break;
-		case 2: ret = sysexit(*((word *)arg1));
+		case 2: ret = sysexit(tf->r1);
 						break;
-    case 3: ret = sysflash(arg1, arg2, arg3);
+    case 3: ret = sysflash((void *)tf->r1, (void *)tf->r2, (void *)tf->r3);
             break;
+		case 4: ret = syssetpriority(tf->r1, tf->r2);
+						break;
+		case 5: ret = sysgetpriority(tf->r1);
+						break;
+		case 6: ret = syssleep(tf->r1);
+						break;
+		case 7: ret = sysyield();
+						break;
+		case 8: ret = sysspawn(tf->r1, tf->r2, tf->r3);
+						break;
+		case 9: ret = syscycles();
+						break;
+		case 10: ret = sysstackuse(tf->r1, (word *)tf->r2);
+						break;
+		case 11: ret = syssbrk(tf->r1);
+						break;
+		case 12: ret = sysshmcreate(tf->r1);
+						break;
+		case 13: ret = sysshmattach(tf->r1);
+						break;
+		case 14: ret = sysshmdetach(tf->r1);
+						break;
+		case 15: ret = sysmeminfo(tf->r1, (struct meminfo *)tf->r2);
+						break;
+		case 16: ret = sysmqcreate(tf->r1, tf->r2);
+						break;
+		case 17: ret = sysmqdestroy(tf->r1);
+						break;
+		case 18: ret = sysmqsend(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 19: ret = sysmqrecv(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 20: ret = syssend(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 21: ret = sysreceive((void *)tf->r1, tf->r2);
+						break;
+		case 22: ret = sysreply(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 23: ret = sysringwait((struct ring *)tf->r1, tf->r2);
+						break;
+		case 24: ret = sysringwake((struct ring *)tf->r1);
+						break;
+		case 25: ret = syssemcreate(tf->r1);
+						break;
+		case 26: ret = syssemdestroy(tf->r1);
+						break;
+		case 27: ret = syssemwait(tf->r1);
+						break;
+		case 28: ret = syssempost(tf->r1);
+						break;
+		case 29: ret = sysmutexcreate();
+						break;
+		case 30: ret = sysmutexdestroy(tf->r1);
+						break;
+		case 31: ret = sysmutexlock(tf->r1);
+						break;
+		case 32: ret = sysmutexunlock(tf->r1);
+						break;
+		case 33: ret = sysfutexwait((volatile word *)tf->r1, tf->r2);
+						break;
+		case 34: ret = sysfutexwake((volatile word *)tf->r1, tf->r2);
+						break;
+		case 35: ret = sysnotify(tf->r1, tf->r2);
+						break;
+		case 36: ret = syswaitbits(tf->r1, tf->r2);
+						break;
+		case 37: ret = syspipe((int *)tf->r1);
+						break;
+		case 38: ret = sysread(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 39: ret = syswrite(tf->r1, (void *)tf->r2, tf->r3);
+						break;
+		case 40: ret = sysclose(tf->r1);
+						break;
 		default: while(1); 
 	}
 /* Store return values */
-	syscreturn(ret);
+	tf->r0 = ret;
+/* The service may have blocked the caller or made something else ready. */
+	reschedule();
 }
 void dm_handler() {
 	while(1);
 }
-void psv_handler() {
-	while(1);
-}
 /* Systick handler (clock tick interrupt) */
-void syst_handler(word sp) {
-/* Don't change the state to RUNNABLE, just go to the scheduler */
-  NVIC_ST_CURRENT_R = 0;
-	if(UNUSED == currproc()->state || WAITING == currproc()->state) {
-		kernel_entry(currproc());
-		scheduler();
-	}
-	else {
-		kernel_entry(currproc());
-		currproc()->state = RUNNABLE;
-		scheduler();
-	}
+void syst_handler() {
+  clock_tick();
+/* Switch if the time slice is up or a woken process has a higher priority. */
+  reschedule();
 }
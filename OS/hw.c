@@ -22,17 +22,34 @@ void systick_init() {
 	return;
 }
 /*
- * Start a system clock tick with interrupts enabled. Interrupts frequencies
- * must be such that the OS has time to complete scheduling and context
- * switching.
+ * Start a system clock tick with interrupts enabled that interrupts every
+ * reload cycles. Interrupts frequencies must be such that the OS has time to
+ * complete scheduling and context switching.
  */
-void start_clocktick() {
+void start_clocktick(word reload) {
 	NVIC_ST_CTRL_R = 0;
-	NVIC_ST_RELOAD_R = CLOCK_TICK*10;
+	NVIC_ST_RELOAD_R = reload;
 	NVIC_ST_CURRENT_R = 0;
 	NVIC_ST_CTRL_R = 0x7;
 	return;
 }
+/*
+ * Restart the running clock tick so that it next interrupts after reload
+ * cycles.
+ */
+void reload_clocktick(word reload) {
+	NVIC_ST_RELOAD_R = reload;
+/* Any write clears the current value, so the new reload is used right away. */
+	NVIC_ST_CURRENT_R = 0;
+	return;
+}
+/*
+ * Returns the number of cycles that have passed in the current clock tick
+ * period.
+ */
+word elapsed_clocktick() {
+	return NVIC_ST_RELOAD_R - NVIC_ST_CURRENT_R;
+}
 /*
  * 1ms delay
  */
@@ -43,6 +60,18 @@ void delay_1ms() {
 	return;
 }
 
+/*
+ * Start the DWT cycle counter. It counts every cpu cycle and can be read with
+ * DWT_CYCCNT_R for timing code.
+ */
+void cyccnt_init() {
+/* Enable the trace and debug blocks (TRCENA). Pg. 163, datasheet. */
+	NVIC_DBG_INT_R |= (1 << 24);
+	DWT_CYCCNT_R = 0;
+	DWT_CTRL_R |= 0x1;
+	return;
+}
+
 /********************************LEDs*****************************************/
 
 /* You can find which pins are LEDs by seeing the Tiva C Series LaunchPad */
@@ -51,7 +80,7 @@ void delay_1ms() {
 
 /*
  * Initialize PortF for led operation. This function must be run before the LEDs
- * can be used.
+ * can be used. The kernel runs it at boot.
  */
 void led_init() {
 	SYSCTL_RCGCGPIO_R |= (1 << 5); //Enable port f
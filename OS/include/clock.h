@@ -0,0 +1,47 @@
+/******************************************************************************
+ * Authour	:	Ben Haubrich
+ * File			:	clock.h
+ * Synopsis	:	Kernel time keeping
+ * Date			:	October 17th, 2026
+ *****************************************************************************/
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <types.h>
+#include <hw.h>
+#include <proc.h>
+
+/* Length of one kernel clock tick in milliseconds. */
+#define TICK_MS 10
+/* Systick reload value for one clock tick. */
+#define TICK_CYCLES (CLOCK_TICK*TICK_MS)
+/* Number of ticks a process runs for before the next process of the same */
+/* priority gets a turn. */
+#define TIMESLICE 1
+/* The most ticks that fit in the 24-bit systick reload register. */
+#define MAX_TICKS (0xFFFFFF / TICK_CYCLES)
+/* Number of buckets in the timer wheel. Must be a power of 2. Timers that */
+/* expire more than WHEEL_SIZE ticks away wait in their bucket for another */
+/* turn of the wheel. */
+#define WHEEL_SIZE 64
+/* Convert milliseconds to ticks, rounding up. Divides before rounding so */
+/* that ms near the largest word doesn't wrap around to a short wait. */
+#define mstoticks(ms) ((ms) / TICK_MS + (0 != (ms) % TICK_MS))
+
+/* Ticks since the clock was started. */
+extern word ticks;
+/* Ticks left in the running processes time slice. */
+extern int slice;
+/* Tick interrupts that were not taken because the kernel had nothing to do. */
+extern word suppressed;
+
+void init_clock(void);
+void clock_tick(void);
+void timer_add(struct pcb *, word);
+void timer_del(struct pcb *);
+#ifdef TICKLESS
+void clock_sync(void);
+void clock_arm(void);
+#endif
+
+#endif /*__CLOCK_H__*/
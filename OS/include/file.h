@@ -0,0 +1,45 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : file.h                                                          *
+ * Synopsis : File descriptors and pipes                                      *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#ifndef __FILE_H__
+#define __FILE_H__
+
+#include <types.h>
+#include <proc.h>
+
+/* Bytes a pipe holds before writers have to wait. */
+#define PIPE_SIZE 128
+
+/* A pipe. Bytes are kept in a ring in the kernel heap, or copied straight */
+/* to a reader that is already waiting. */
+struct pipe {
+	char *buf; /* PIPE_SIZE bytes from kmalloc(). */
+	word head; /* Index of the oldest byte. */
+	word count; /* Number of bytes in the pipe. */
+	int nreaders; /* Open files for the read end. */
+	int nwriters; /* Open files for the write end. */
+	struct waitq readq; /* Processes waiting for bytes. */
+	struct waitq writeq; /* Processes waiting for room. */
+};
+
+/* Kinds of open files. */
+enum filetype {FD_PIPEREAD, FD_PIPEWRITE};
+
+/* An open file, shared by every file descriptor that refers to it. */
+struct file {
+	enum filetype type;
+	int refs; /* Number of file descriptors that refer to it. */
+	struct pipe *pipe;
+};
+
+int syspipe(int *);
+int sysread(int, void *, word);
+int syswrite(int, void *, word);
+int sysclose(int);
+void file_fork(struct pcb *, struct pcb *);
+void file_exit(struct pcb *);
+
+#endif /*__FILE_H__*/
@@ -13,13 +13,19 @@
 #define SYS_CLOCK_FREQ 16000000
 /* Systick uses PIOSC/4. So the clock tick is based of a 4MHz frequency. */
 #define CLOCK_TICK 4000 //1ms
+/* DWT cycle counter registers. They are not in tm4c123gh6pm.h */
+#define DWT_CTRL_R (*((volatile unsigned long *)0xE0001000))
+#define DWT_CYCCNT_R (*((volatile unsigned long *)0xE0001004))
 /* Supported baud rates for UART */
 #define B115200 115200u
 
 /* Systick calls */
 void systick_init(void);
-void start_clocktick(void);
+void start_clocktick(word);
+void reload_clocktick(word);
+word elapsed_clocktick(void);
 void delay_1ms(void);
+void cyccnt_init(void);
 /* LED calls */
 void led_init(void);
 void led_ron(void);
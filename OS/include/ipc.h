@@ -0,0 +1,43 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : ipc.h                                                           *
+ * Synopsis : Interprocess communication                                      *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#ifndef __IPC_H__
+#define __IPC_H__
+
+#include <types.h>
+#include <proc.h>
+#include <ring.h>
+
+/* Most message queues that can exist at once. */
+#define NMQ 8
+
+/* Message queue. Messages are copied into a ring of fixed size slots in */
+/* kernel ram, or straight to a receiver that is already waiting. */
+struct mq {
+	word msgsize; /* Size of every message in bytes. */
+	word nslots; /* Number of messages the queue can hold. */
+	word head; /* Slot of the oldest message. */
+	word count; /* Number of messages in the queue. */
+	word buf; /* Slots, from get_ram(). */
+	struct waitq senders; /* Processes waiting for a free slot. */
+	struct waitq receivers; /* Processes waiting for a message. */
+};
+
+void init_ipc(void);
+int sysmqcreate(word, word);
+int sysmqdestroy(int);
+int sysmqsend(int, void *, word);
+int sysmqrecv(int, void *, word);
+int syssend(int, void *, word);
+int sysreceive(void *, word);
+int sysreply(int, void *, word);
+void ipc_exit(struct pcb *);
+int sysringwait(struct ring *, word);
+int sysringwake(struct ring *);
+int sysnotify(int, word);
+int syswaitbits(word, word);
+
+#endif /*__IPC_H__*/
@@ -7,9 +7,24 @@
 #ifndef __KERNELSERVICES_H__
 #define __KERNELSERVICES_H__
 
+#include <types.h>
+#include <proc.h>
+
 int sysflash(void *, void *, void *);
-int sysfork(void);
-int syswait(int);
+int sysfork(struct trapframe *, struct context *);
+int syswait(int, int *);
 int sysexit(int);
+int syssetpriority(int, int);
+int sysgetpriority(int);
+int syssleep(word);
+int sysyield(void);
+int sysspawn(word, word, word);
+word syscycles(void);
+int sysstackuse(int, word *);
+word syssbrk(word);
+int sysshmcreate(word);
+word sysshmattach(int);
+int sysshmdetach(int);
+int sysmeminfo(int, struct meminfo *);
 
 #endif /*__KERNELSERVICES_H__*/
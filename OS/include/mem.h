@@ -7,6 +7,7 @@
 #ifndef __MEM_H__
 #define __MEM_H__
 
+#include <tm4c123gh6pm.h>
 #include <types.h>
 #include <proc.h>
 
@@ -16,11 +17,32 @@ extern void *smainsize;
 extern int smain(void);
 /* From vectors.s */
 extern const int KRAM_USE;
+/* From link.ld. Where the kernel's sections are in ram. */
+extern word _data;
+extern word _edata;
+extern word _bss;
+extern word _ebss;
+extern word _sync;
+extern word _esync;
+extern word _heap;
+extern word _eheap;
+extern word _stack;
+extern word _estack;
 
-/* Process stack size. This is independant of the kernel stack which is */
-/* created in vectors.s at the top of the vector table. If you change this */
-/* value, also change the stack size used in Reset_EXCP. */
-#define STACK_SIZE 0x400 /*1KB Stack */
+/* Default process stack size. This is independant of the kernel stack which */
+/* is created in vectors.s at the top of the vector table. It is what is left */
+/* of a 1KB block above the guard. */
+#define STACK_SIZE 0x380
+/* Smallest process stack. Fits an exception frame with the fpu registers */
+/* and a few function calls. MPU subregions need a block of at least 256 */
+/* bytes, and this is what is left of it above the guard. */
+#define STACK_MIN 0xE0
+/* Unused stack is filled with this so that the deepest the stack has ever */
+/* been can be found later. */
+#define STACK_CANARY 0xC0FFEE11
+/* Ram is handed out in blocks of a power of two granules. If you change */
+/* this value, also change the granule size used in Reset_EXCP. */
+#define RAM_GRAIN 0x80
 /* Do not change the value of flash page size. flash memory protection is */
 /* based off 2KB page sizes. */
 #define FLASH_PAGE_SIZE 0x800
@@ -34,8 +56,10 @@ extern const int KRAM_USE;
 #define FLASH_ 0x00040000
 /* Number of flash pages. */
 #define FLASH_PAGES FLASH_ / FLASH_PAGE_SIZE
-/* Number of SRAM Pages. */
-#define SRAM_PAGES (SRAM_ - _SRAM) / STACK_SIZE
+/* Number of SRAM granules. */
+#define RAM_GRAINS ((SRAM_ - _SRAM) / RAM_GRAIN)
+/* Number of block sizes, from one granule to all of SRAM. */
+#define RAM_ORDERS 9
 /* 1 KB */
 #define KB 1024u
 /* 1 MB */
@@ -45,11 +69,93 @@ extern const int KRAM_USE;
 /* Number of flash pages used by the kernel */
 #define KFLASHPGS ((KSIZE / FLASH_PAGE_SIZE) + 1)
 
-/* The top of stack for any process given the ram page, x. */
-#define stacktop(x) _SRAM + x*STACK_SIZE - 4
+/* kmalloc() sizes are rounded up to a power of two from KMALLOC_MIN to */
+/* KMALLOC_MAX, with one pool of blocks for each size. */
+#define KMALLOC_MIN 16
+#define KMALLOC_MAX 256
+#define KMALLOC_POOLS 5
 
-int get_stackspace(void);
-void free_stackspace(int);
+/* A pool of kernel heap blocks of one size. */
+struct kpool {
+	void *free; /* Freed blocks, linked through their first word. */
+	word size; /* Size of the blocks in bytes. */
+	word inuse; /* Blocks allocated and not yet freed. */
+	word allocs; /* Total number of allocations. */
+	word fails; /* Allocations that failed because the heap was used up. */
+};
+
+/* Most shared memory segments that can exist at once. */
+#define NSHM 8
+
+/* A segment of ram that processes can share by attaching it. */
+struct shm {
+	word addr;
+	word size;
+	int refs; /* Number of processes that have it attached. */
+};
+
+/* Memory use, from the meminfo system call. All sizes are in bytes. */
+struct meminfo {
+	word data; /* Kernel .data */
+	word bss; /* Kernel .bss, which has the process table */
+	word kheap; /* Kernel heap */
+	word kheapused; /* Part of the kernel heap given out to kmalloc() pools */
+	word kstack; /* Kernel stack */
+	word kram; /* All the ram the kernel keeps for itself */
+	word ramfree; /* Ram that processes can still get */
+	word largest; /* Largest block of ram one process can still get */
+	word stack; /* Stack of the process, not counting the guard */
+	word stackpeak; /* Most of its stack the process has used */
+	word heap; /* Ram the process got from sbrk() */
+	word shm; /* Shared memory the process has attached */
+};
+
+/* Peripherals that user processes may use directly. The region covers the */
+/* first 256KB of them, but only two of its 32KB subregions are enabled, the */
+/* one with UART1 and the one with GPIO port F. Everything else, like the */
+/* system control registers, the flash controller and uDMA, which could */
+/* write anywhere, is left to the kernel. */
+#define _PERIPH 0x40000000
+#define PERIPH_ 0x40040000
+#define PERIPH_SUBREGIONS ((1 << 1) | (1 << 4))
+/* MPU regions. The kernel uses the default memory map. Processes can only */
+/* use their own regions and the ones that are shared by everyone. */
+#define MPU_FLASH 0 /* Code and read only data, shared. */
+#define MPU_PERIPH 1 /* Peripherals, shared. */
+#define MPU_STACK 2 /* Process stack. */
+#define MPU_HEAP 3 /* First of the process heap regions. */
+#define MPU_SHM 5 /* First of the process shared memory regions. */
+#define MPU_SYNC 7 /* Semaphore and mutex words, shared. */
+/* Access permissions for privileged and user code (RASR AP). */
+#define MPU_RO (0x6 << 24)
+#define MPU_RW (0x3 << 24)
+/* Memory types (RASR TEX, S, C and B). Pg. 126, datasheet. */
+#define MPU_FLASHMEM NVIC_MPU_ATTR_CACHEABLE
+#define MPU_SRAM (NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_CACHEABLE)
+#define MPU_DEVICE (NVIC_MPU_ATTR_SHAREABLE | NVIC_MPU_ATTR_BUFFRABLE)
+/* RBAR value that selects region n at addr. */
+#define mpu_base(addr, n) ((word)(addr) | NVIC_MPU_BASE_VALID | (n))
+
+/* The top of stack for the process p. */
+#define stacktop(p) ((p)->stack + (p)->stacksize - 4)
+/* Bytes at the bottom of the stack of p that it can not use. The lowest of */
+/* the 8 subregions of the MPU stack region is disabled, so a process that */
+/* runs off the end of its stack faults before it reaches its neighbour. */
+#define stackguard(p) ((p)->stacksize / 8)
+
+/* From proc.h, which may be including this file. */
+struct pcb;
+
+word ramsize(word);
+word get_ram(word);
+void free_ram(word, word);
 void init_ram(void);
+void *kmalloc(word);
+void kfree(void *, word);
+void init_kheap(void);
+void raminfo(struct meminfo *);
+int checkuser(struct pcb *, word, word);
+word mpu_attr(word, word);
+void init_mpu(void);
 
 #endif /*__MEM_H__*/
@@ -10,22 +10,51 @@
 #include <types.h>
 #include <mem.h>
 
-/* Every process needs a stack, so max processes is how many stacks can fit */
-/* in ram at the same time. The size of the kernel can not be pre-processed */
-/* since it's calculated at startup in RESET_EXCP. The OS will ward you if */
-/* MAX_PROC is defined to be too large by doing a single runtime check in */
-/* user_init. */
-#define MAX_PROC 25
+/* Stacks are sized per process, so how many fit in ram depends on what is */
+/* running. Creating a process fails when there isn't room for its stack. */
+#define MAX_PROC 32
+/* The scheduler keeps one bit per pid in a single word. */
+#if MAX_PROC > 32
+#error "MAX_PROC can not be larger than the number of bits in a word"
+#endif
 /* That maximum number of creatable processes, which accounts for the */
 /* the creation of initshell during OS initialization. */
 #define NPROC MAX_PROC - 1
 /* A pid that no valid process will ever have. */
 #define NULLPID MAX_PROC + 1
+/* Pid for waiting on any child process. */
+#define ANYPID -1
+/* Pid of initshell. It adopts the children of processes that exit. */
+#define INITPID 0
+/* Timeout for blocking calls that never time out. */
+#define WAIT_FOREVER 0xFFFFFFFF
+/* Returned by blocking calls that timed out. Not -1, so that it can't be */
+/* mistaken for a failure. */
+#define TIMEDOUT -2
+/* Bits a process can be notified with. The top bit of a wait_bits() mask */
+/* asks for all of the bits instead of any of them. */
+#define NOTIFY_BITS 0x7FFFFFFF
+#define WAIT_ALL 0x80000000
+/* Number of scheduling priorities. The scheduler keeps one bit per level in */
+/* a single word. */
+#define NPRIO 8
+#if NPRIO > 32
+#error "NPRIO can not be larger than the number of bits in a word"
+#endif
+/* Lowest and highest priorities. Higher priorities always run first. */
+#define PRIO_MIN 0
+#define PRIO_MAX (NPRIO - 1)
+/* Priority of initshell. Children inherit the priority of their parent. */
+#define PRIO_DEFAULT (NPRIO / 2)
 /* Exit codes */
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
-/* Context switch stack size (in bytes, 4 bytes per word saved) */
-#define CTXSTACK 32
+/* EXC_RETURN value for returning to thread mode on the process stack. */
+#define EXC_RETURN_PSP 0xFFFFFFFD
+/* EXC_RETURN bit that is clear when the processor stacked fpu registers. */
+#define EXC_RETURN_NOFPU 0x10
+/* xPSR with only the thumb bit set. */
+#define XPSR_THUMB 0x01000000
 
 /*
  * KERNEL:
@@ -38,49 +67,153 @@
  * EMBRYO:
  * 	The process is midway through initialization
  * SLEEPING:
- * 	The process has been put to sleep and will not be run next scheduling cycle
+ * 	The process is in the timer wheel and will not be run until its wakeup
+ * 	tick
  * RUNNABLE:
  * 	The process is ready to be scheduled
  * RUNNING:
  * 	The process is currently executing code
  * WAITING:
- * 	The processes is waiting for another process to exit
+ * 	The processes is waiting for another process to exit. It is in the
+ * 	waiters queue of that process, or waiting for any of its children if
+ * 	waitpid is ANYPID
+ * ZOMBIE:
+ * 	The process has exited and keeps its exit status until its parent
+ * 	reaps it with wait
+ * BLOCKED:
+ * 	The process is in the wait queue of an ipc object, like a message
+ * 	queue, and may also be in the timer wheel if it gave a timeout
+ * SEND_BLOCKED:
+ * 	The process sent a message to ipcpid and is in the senders queue of
+ * 	ipcpid until it receives it
+ * RECEIVE_BLOCKED:
+ * 	The process is waiting to receive a message from anyone
+ * REPLY_BLOCKED:
+ * 	The message the process sent was received by ipcpid, and it is
+ * 	waiting for ipcpid to reply
  */
-enum procstate {UNUSED, RESERVED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, WAITING};
+enum procstate {UNUSED, RESERVED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, WAITING,
+                ZOMBIE, BLOCKED, SEND_BLOCKED, RECEIVE_BLOCKED, REPLY_BLOCKED};
 
-/* Note that any changes to a processes context do not take affect until */
-/* The next time a context switch changes to it. The registers here are */
-/* based off of the ones saved the cortex M4 exception return stack */
-/* r7 always needs the current stack pointer, and is taken care of in swtch */
+/* Registers the processor pushes onto the process stack when it enters an */
+/* exception. When the process was using the fpu, s0-s15 and fpscr follow. */
+struct trapframe {
+	word r0;
+	word r1;
+	word r2;
+	word r3;
+	word r12;
+	word lr;
+	word pc;
+	word xpsr;
+};
+
+/* Registers swtch() pushes onto the process stack below the trapframe, so */
+/* that the process can be switched back to later. lr holds the EXC_RETURN */
+/* value. When it says the fpu was in use, s16-s31 are saved between this */
+/* and the trapframe. The svc entry in vectors.s pushes the same layout onto */
+/* the kernel stack. */
 struct context {
-	 word sp;
-	 word pc;
-	 word lr;
-	 word r0;
-	 word r3;
-   word r7;
-	 word r12;
+	word r4;
+	word r5;
+	word r6;
+	word r7;
+	word r8;
+	word r9;
+	word r10;
+	word r11;
+	word lr;
+};
+
+/* A list of processes blocked on the same event. The highest priority */
+/* process is first, and processes of the same priority are in the order */
+/* they blocked. */
+struct waitq {
+	struct pcb *head;
 };
 
 /* Process control block. */
 /* *** Don't forget to initialise values in init_ptable if needed *** */
+/* Number of ram regions a process can be granted for its heap. */
+#define MPU_HEAPREGIONS 2
+/* Number of shared memory segments a process can have attached at once. */
+#define MPU_SHMREGIONS 2
+/* Number of MPU regions each process has to itself. They follow the regions */
+/* every process shares, see mem.h. Region 0 of a process is its stack, then */
+/* come the heap regions and then the shared memory regions. */
+#define MPU_PROCREGIONS (1 + MPU_HEAPREGIONS + MPU_SHMREGIONS)
+#define PROC_HEAPREGION 1
+#define PROC_SHMREGION (1 + MPU_HEAPREGIONS)
+/* Number of file descriptors a process can have open. */
+#define NFD 8
+
+/* Open file, see file.h. */
+struct file;
+
 struct pcb {
-	struct context context; /* CPU register context */
+	struct context *context; /* Saved registers, on the process stack */
 	char name[16];	/* For debugging */
 	int numchildren; /* Number of child processes. */
 	int pid; /* Process ID */
 	int ppid; /* Parent process ID */
 	int waitpid; /* Process is waiting for this pid to change state.*/
-	int initflag; /* 0 for not initialised yet, 1 for initialised. */
-	int rampg; /* Index of this processes allocated ram page. */
+	int *waitstatus; /* Where to put the exit status of the reaped child. */
+	int exitstatus; /* Exit code, kept while the process is a ZOMBIE. */
+	struct pcb *child; /* First child process. */
+	struct pcb *sibling; /* Next child process of the same parent. */
+	word stack; /* Lowest address of the process stack. */
+	word stacksize; /* Size of the process stack in bytes. */
+	word heap[MPU_HEAPREGIONS]; /* Ram regions granted by sbrk, or 0. */
+	word heapsize[MPU_HEAPREGIONS]; /* Size of each heap region in bytes. */
+	int shm[MPU_SHMREGIONS]; /* Ids of attached shared memory, or -1. */
+	word mpu[2*MPU_PROCREGIONS]; /* RBAR and RASR of each of its MPU regions. */
+	int priority; /* Scheduling priority from PRIO_MIN to PRIO_MAX */
+	int basepriority; /* Priority it was given, before any inheritance. */
+	int lockwait; /* Mutex the process is blocked on, or -1. */
+	int timed; /* 1 while the process is in the timer wheel. */
+	word wakeat; /* Tick to wake up at when in the timer wheel. */
+	struct pcb *tnext; /* Next process in the same timer wheel bucket. */
+	struct pcb *tprev; /* Previous process in the same timer wheel bucket. */
+	struct waitq *waitq; /* Wait queue the process is blocked on, if any. */
+	struct pcb *qnext; /* Next process in the same wait queue. */
+	struct pcb *qprev; /* Previous process in the same wait queue. */
+	struct waitq waiters; /* Parent, when it is waiting for this process. */
+	word ipcbuf; /* User buffer of a blocked ipc call. */
+	word ipcsize; /* Size of ipcbuf in bytes. */
+	int ipcpid; /* Process a send is blocked on. */
+	struct waitq senders; /* Processes that sent to this one, SEND_BLOCKED. */
+	word notified; /* Notification bits set and not yet waited for. */
+	word notewait; /* wait_bits() mask while it is blocked in it. */
+	struct file *ofile[NFD]; /* Open files by file descriptor, or NULL. */
+	word retval; /* Return value of a blocked system call, set by the waker. */
+	int hasretval; /* 1 when retval has to be given to the process. */
 	enum procstate state; /* Process state */
 };
 
 void user_init(void);
-struct pcb* reserveproc(char *);
+struct pcb* reserveproc(char *, word);
+void initcontext(struct pcb *, word, word);
+struct trapframe *trapframe(struct pcb *);
 void init_ptable(void);
+void freeproc(struct pcb *);
+void setregion(struct pcb *, int, word, word);
+void paintstack(struct pcb *);
+word stackpeak(struct pcb *);
 struct pcb *currproc(void);
 struct pcb *pidproc(int);
-void scheduler(void) __attribute__((noreturn));
+void enqueue(struct pcb *);
+void dequeue(struct pcb *);
+void changepriority(struct pcb *, int);
+void sleepon(struct waitq *, enum procstate);
+void sleepfor(struct waitq *, enum procstate, word);
+void setreturn(struct pcb *, word);
+void handoff(struct pcb *);
+void unblock(struct pcb *);
+void wakeproc(struct pcb *);
+struct pcb *wakeone(struct waitq *);
+int timesliced(void);
+void preempt(void);
+void reschedule(void);
+word scheduler(word);
 
 #endif /*__PROC_H__*/
@@ -0,0 +1,32 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : ring.h                                                          *
+ * Synopsis : Lock free single producer, single consumer ring of words        *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <types.h>
+
+/* Bytes needed for a ring of n items. */
+#define RING_BYTES(n) (sizeof(struct ring) + (n)*sizeof(word))
+
+/* Ring of words passed from one producer to one consumer, which can be an */
+/* interrupt handler and a process, or two processes sharing memory. head is */
+/* only written by the producer and tail only by the consumer, so neither */
+/* side needs a lock or has to disable interrupts. The indices count every */
+/* item ever put or taken and wrap around on their own. */
+struct ring {
+	volatile word head; /* Number of items put. */
+	volatile word tail; /* Number of items taken. */
+	word size; /* Number of items the ring holds. A power of 2. */
+	word buf[];
+};
+
+void ring_init(struct ring *, word);
+int ring_put(struct ring *, word);
+int ring_get(struct ring *, word *);
+word ring_count(struct ring *);
+
+#endif /*__RING_H__*/
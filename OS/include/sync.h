@@ -0,0 +1,61 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : sync.h                                                          *
+ * Synopsis : Semaphores and mutexes                                          *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#ifndef __SYNC_H__
+#define __SYNC_H__
+
+#include <types.h>
+#include <proc.h>
+#include <mem.h> /* For _sync */
+
+/* Most semaphores and mutexes that can exist at once. */
+#define NSEM 8
+#define NMUTEX 8
+/* Set in a semaphore or mutex word while processes are blocked on it. */
+#define SEM_WAITERS 0x80000000
+#define MUTEX_WAITERS 0x80000000
+/* Number of futex wait queues. Addresses are hashed to one of them. */
+#define NFUTEXQ 16
+
+/* Mutex built on futex_wait() and futex_wake(), in memory of the process */
+/* or shared memory. state is 0 when it is unlocked, 1 when it is locked and */
+/* 2 when it is locked and processes may be waiting for it. */
+struct umutex {
+	volatile word state;
+};
+
+/* Semaphore and mutex words, in ram that every process can read and write */
+/* through MPU_SYNC. Processes take and give them with cas() and only enter */
+/* the kernel when they have to wait or wake someone up. A semaphore word is */
+/* its count. A mutex word is 0 when it is free, otherwise the pid of its */
+/* owner plus one. Either may have the WAITERS bit set, which only the */
+/* kernel changes. */
+struct syncpage {
+	word pid; /* Pid of the running process, set by scheduler(). */
+	volatile word sem[NSEM];
+	volatile word mutex[NMUTEX];
+};
+
+#define syncpage ((struct syncpage *)&_sync)
+
+/* From context.s */
+int cas(volatile word *, word, word);
+
+void init_sync(void);
+int syssemcreate(word);
+int syssemdestroy(int);
+int syssemwait(int);
+int syssempost(int);
+int sysmutexcreate(void);
+int sysmutexdestroy(int);
+int sysmutexlock(int);
+int sysmutexunlock(int);
+int lockpriority(struct pcb *);
+void sync_exit(struct pcb *);
+int sysfutexwait(volatile word *, word);
+int sysfutexwake(volatile word *, int);
+
+#endif /*__SYNC_H__*/
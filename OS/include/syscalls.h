@@ -7,9 +7,55 @@
 #ifndef __SYSCALLS_H__
 #define __SYSCALLS_H__
 
+#include <types.h>
+#include <mem.h> /* For struct meminfo */
+#include <ring.h> /* For struct ring */
+#include <sync.h> /* For struct umutex */
+
 int flash(void *, void *, void *);
 int fork(void);
+int waitpid(int, int *);
 int wait(int);
+int setpriority(int, int);
+int getpriority(int);
+int sleep_ms(word);
+int yield(void);
+int spawn(int (*)(word), word, word);
+word cycles(void);
+int stackuse(int, word *);
+void *sbrk(word);
+int shm_create(word);
+void *shm_attach(int);
+int shm_detach(int);
+int meminfo(int, struct meminfo *);
+int mq_create(word, word);
+int mq_destroy(int);
+int mq_send(int, void *, word);
+int mq_recv(int, void *, word);
+int send(int, void *, word);
+int receive(void *, word);
+int reply(int, void *, word);
+int ring_wait(struct ring *, word);
+int ring_wake(struct ring *);
+int sem_create(word);
+int sem_destroy(int);
+int sem_wait(int);
+int sem_post(int);
+int mutex_create(void);
+int mutex_destroy(int);
+int mutex_lock(int);
+int mutex_unlock(int);
+int futex_wait(volatile word *, word);
+int futex_wake(volatile word *, int);
+void umutex_init(struct umutex *);
+void umutex_lock(struct umutex *);
+void umutex_unlock(struct umutex *);
+int notify(int, word);
+int wait_bits(word, word);
+int pipe(int [2]);
+int read(int, void *, word);
+int write(int, void *, word);
+int close(int);
 int exit(int) __attribute__((noreturn));
 
 #endif /*__SYSCALLS_H__*/
@@ -0,0 +1,49 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : tlsf.h                                                          *
+ * Synopsis : Two level segregated fit allocator for user heaps               *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#ifndef __TLSF_H__
+#define __TLSF_H__
+
+#include <types.h>
+
+/* Every block is a multiple of this many bytes, and so is every address */
+/* that heap_alloc() returns. */
+#define HEAP_ALIGN 8
+/* Number of second level lists for each power of two. */
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+/* Blocks smaller than this are all in the first first level list. */
+#define FL_SHIFT (SL_LOG2 + 3)
+#define HEAP_SMALL (1 << FL_SHIFT)
+/* Largest block is smaller than 2^FL_MAX bytes. All of SRAM is 2^15. */
+#define FL_MAX 16
+#define FL_COUNT (FL_MAX - FL_SHIFT + 1)
+
+/* Block header. The size of the block doesn't include the header. The */
+/* lowest bit of size is set when the block is free. next and prev are only */
+/* there when the block is free, and are part of the block otherwise. */
+struct hblock {
+	struct hblock *prevphys; /* The block right before this one in memory. */
+	word size;
+	struct hblock *next; /* Free blocks in the same list. */
+	struct hblock *prev;
+};
+
+/* The allocator's state. It's kept at the start of the first region of the */
+/* heap, since processes have no memory of their own besides their stacks. */
+struct heap {
+	word flmap; /* Bit n is set when slmap[n] isn't 0. */
+	word slmap[FL_COUNT]; /* Bit m of slmap[n] is set when free[n][m] isn't */
+	                      /* empty. */
+	struct hblock *free[FL_COUNT][SL_COUNT];
+};
+
+struct heap *heap_init(word);
+int heap_grow(struct heap *, word);
+void *heap_alloc(struct heap *, word);
+void heap_free(struct heap *, void *);
+
+#endif /*__TLSF_H__*/
@@ -13,24 +13,42 @@
 #include <cstring.h>
 #include <types.h>
 #include <fs.h>
+#include <clock.h>
+#include <ipc.h>
+#include <sync.h>
 
 /* From proc.c */
 extern struct pcb ptable[];
+/* From vectors.s */
+extern void processor_state(int);
 
 int main() {
+/* Interrupts stay disabled until the first process is ready to run. */
+	processor_state(0);
 /* Enable all the faults and exceptions. Pg. 173, datasheet */
 	NVIC_SYS_HND_CTRL_R |= (1 << 16); /* MEM Enable */
 	NVIC_SYS_HND_CTRL_R |= (1 << 17); /* BUS Enable */
 	NVIC_SYS_HND_CTRL_R |= (1 << 18); /* USAGE Enable */
   uart1_init(B115200);
+/* Processes can use the leds, but not the system control registers that */
+/* turn on their port. */
+	led_init();
   printf("Initialising tm4c_os\n\r");
 /* Configure Interrupt priorities. SVC exceptions are higher priority */
-/* than tick interrupts. SVC is 0 and systick is 1. */
+/* than tick interrupts. SVC is 0 and systick is 1. PendSV does the context */
+/* switching, so it is the lowest (7) to run after every other exception. */
 	NVIC_SYS_PRI3_R |= (1 << 29);
+	NVIC_SYS_PRI3_R |= (7 << 21);
+/* For the cycles system call, and swtch() statistics. */
+	cyccnt_init();
 	init_ram();
+	init_kheap();
+	init_ipc();
+	init_sync();
+	init_mpu();
 	init_ptable();
 	init_fs();
-	start_clocktick();
+	init_clock();
 /* Set up the first user process (the shell) */
 	user_init();
 	return 0;
@@ -11,6 +11,8 @@
 #include <syscalls.h>
 #include <mem.h> /* For flash address macros */
 #include <cstring.h> /* For testing cstring api */
+#include <sync.h> /* For syncpage */
+#include <tlsf.h> /* For the user heap */
 
 /*
  * Got nothing to do? How about counting to 10 million?
@@ -22,25 +24,28 @@ void count() {
 
 /* 
  * The led should be purple when this test is done.
- * First the parent turns on the green led, then forks NPROC processes. The
- * children all turn off the green led and then exit while the parent waits
- * for them. When all the children have exited, the parent turns on the red
- * led and then exits.
+ * First the parent turns on the green led, then forks up to NPROC processes,
+ * as many as there is ram for. The children all turn off the green led and
+ * then exit while the parent waits for them. The led registers are shared,
+ * so they take turns with a mutex. When all the children have exited, the
+ * parent turns on the red led and then exits.
  */
 void forktest() {
-	led_init();
 	led_gron();
-	int i;
+	int i, n;
 	int pids[NPROC];
-	for(i = 0; i < NPROC; i++) {
-		pids[i] = fork();
-		if(-1 == pids[i]) {
-			exit(EXIT_FAILURE);
+	int led = mutex_create();
+	for(n = 0; n < NPROC; n++) {
+		pids[n] = fork();
+		if(-1 == pids[n]) {
+			break;
 		}
-		if(NULLPID == pids[i]) {
+		if(NULLPID == pids[n]) {
 			/* Child process */
       count();
+			mutex_lock(led);
 			led_groff();
+			mutex_unlock(led);
 			exit(EXIT_SUCCESS);
 			led_gron();
 		}
@@ -49,13 +54,763 @@ void forktest() {
 			led_blon();
 		}
 	}
-	for(i = 0; i < NPROC; i++) {
+	for(i = 0; i < n; i++) {
 		wait(pids[i]);
 	}
+	mutex_destroy(led);
 	led_ron();
 	exit(EXIT_SUCCESS);
 }
 
+/*
+ * Children sleep for different amounts of time instead of counting, so the
+ * cpu is free while they wait. The blue led is on until they have all woken
+ * up and exited.
+ */
+void sleeptest() {
+	led_blon();
+	int i;
+	int pids[4];
+	for(i = 0; i < 4; i++) {
+		pids[i] = fork();
+		if(-1 == pids[i]) {
+			exit(EXIT_FAILURE);
+		}
+		if(NULLPID == pids[i]) {
+			/* Child process */
+			sleep_ms((4 - i) * 100);
+			exit(EXIT_SUCCESS);
+		}
+	}
+	for(i = 0; i < 4; i++) {
+		wait(pids[i]);
+	}
+	led_bloff();
+}
+
+/*
+ * Child of spawntest(). Exits right away.
+ */
+int spawnchild(word arg) {
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Times creating up to NPROC children with fork() and then the same number
+ * with spawn(), and prints the average number of cycles per child for each.
+ * The fork children exit right away too, so both only measure creation. Both
+ * get stacks of the same size. Then spawns NPROC children with the smallest
+ * stacks to show that they all fit.
+ */
+void spawntest() {
+	int i, n;
+	int pids[NPROC];
+	word start, forkcycles, spawncycles;
+	start = cycles();
+	for(n = 0; n < NPROC; n++) {
+		pids[n] = fork();
+		if(-1 == pids[n]) {
+			break;
+		}
+		if(NULLPID == pids[n]) {
+			/* Child process */
+			exit(EXIT_SUCCESS);
+		}
+	}
+	forkcycles = cycles() - start;
+	for(i = 0; i < n; i++) {
+		wait(pids[i]);
+	}
+	start = cycles();
+	for(i = 0; i < n; i++) {
+		pids[i] = spawn(spawnchild, 0, STACK_SIZE);
+	}
+	spawncycles = cycles() - start;
+	for(i = 0; i < n; i++) {
+		wait(pids[i]);
+	}
+	printf("%i children. fork: %i cycles, spawn: %i cycles per child\n\r", \
+			n, forkcycles / n, spawncycles / n);
+	for(n = 0; n < NPROC; n++) {
+		if(-1 == (pids[n] = spawn(spawnchild, 0, STACK_MIN))) {
+			printf("Only %i small stacks fit\n\r", n);
+			break;
+		}
+	}
+	for(i = 0; i < n; i++) {
+		wait(pids[i]);
+	}
+}
+
+/* Processes that share the cpu in fairtest(), and for how long. */
+#define FAIRTEST_PROCS 4
+#define FAIRTEST_MS 1000
+
+/* Shared memory of fairtest(). Slot FAIRTEST_PROCS belongs to the child with */
+/* a lower priority. */
+struct fairness {
+	volatile word stop;
+	volatile word counts[FAIRTEST_PROCS + 1];
+};
+
+/*
+ * Child of fairtest(). Counts in its slot of the shared memory segment until
+ * the shell tells it to stop. The segment is in the low half of arg and the
+ * slot in the high half.
+ */
+int fairchild(word arg) {
+	struct fairness *f = shm_attach(arg & 0xFFFF);
+	if(NULL == f) {
+		return EXIT_FAILURE;
+	}
+	while(!f->stop) {
+		f->counts[arg >> 16]++;
+	}
+	shm_detach(arg & 0xFFFF);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Children of the same priority, below the shell's, count for FAIRTEST_MS
+ * while the shell sleeps, and have to get about the same number of time
+ * slices each. Another child of a lower priority still must not run at all
+ * until they exit. The shell has to get the cpu back as soon as it wakes up,
+ * or it would never stop them. Prints the smallest and largest count.
+ */
+void fairtest() {
+	int id = shm_create(sizeof(struct fairness));
+	struct fairness *f = shm_attach(id);
+	int priority = getpriority(INITPID);
+	int i, n, status;
+	int pids[FAIRTEST_PROCS + 1];
+	word counts[FAIRTEST_PROCS + 1];
+	word least = ~0u, most = 0;
+	int failed = 0;
+	if(NULL == f || priority < PRIO_MIN + 2) {
+		printf("fairtest failed\n\r");
+		return;
+	}
+	memset((void *)f, 0, sizeof(struct fairness));
+/* A child may get a slice before the shell lowers it, so only what they */
+/* count while the shell sleeps is compared. */
+	for(n = 0; n <= FAIRTEST_PROCS; n++) {
+		if(-1 == (pids[n] = spawn(fairchild, id | n << 16, 0))) {
+			failed = 1;
+			break;
+		}
+		setpriority(pids[n], FAIRTEST_PROCS == n ? priority - 2 : priority - 1);
+	}
+	if(!failed) {
+		for(i = 0; i <= FAIRTEST_PROCS; i++) {
+			counts[i] = f->counts[i];
+		}
+		sleep_ms(FAIRTEST_MS);
+		for(i = 0; i <= FAIRTEST_PROCS; i++) {
+			counts[i] = f->counts[i] - counts[i];
+		}
+	}
+	f->stop = 1;
+	for(i = 0; i < n; i++) {
+		status = EXIT_FAILURE;
+		waitpid(pids[i], &status);
+		if(EXIT_SUCCESS != status) {
+			failed = 1;
+		}
+	}
+	shm_detach(id);
+	if(failed) {
+		printf("fairtest failed\n\r");
+		return;
+	}
+	for(i = 0; i < FAIRTEST_PROCS; i++) {
+		if(counts[i] < least) {
+			least = counts[i];
+		}
+		if(counts[i] > most) {
+			most = counts[i];
+		}
+	}
+	if(0 == least || 2*least < most || 0 != counts[FAIRTEST_PROCS]) {
+		printf("fairtest failed\n\r");
+		return;
+	}
+	printf("round robin: %i to %i counts per process\n\r", least, most);
+}
+
+/*
+ * Allocates buffers that are bigger than would fit on the stack, checks that
+ * they don't overlap, frees them and allocates one buffer that only fits if
+ * they were merged back together. Runs in a child, since the heap is only
+ * given back when the process exits.
+ */
+int heapchild(word arg) {
+	struct heap *h = heap_init(4*KB);
+	char *a, *b;
+	int i;
+	if(NULL == h) {
+		return EXIT_FAILURE;
+	}
+	a = heap_alloc(h, 1500);
+	b = heap_alloc(h, 1500);
+	if(NULL == a || NULL == b) {
+		return EXIT_FAILURE;
+	}
+	memset(a, 'a', 1500);
+	memset(b, 'b', 1500);
+	for(i = 0; i < 1500; i++) {
+		if('a' != a[i]) {
+			return EXIT_FAILURE;
+		}
+	}
+	heap_free(h, a);
+	heap_free(h, b);
+	if(NULL == heap_alloc(h, 3*KB)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+void heaptest() {
+	int status = EXIT_FAILURE;
+	waitpid(spawn(heapchild, 0, 0), &status);
+	if(EXIT_SUCCESS != status) {
+		printf("heaptest failed\n\r");
+	}
+}
+
+/*
+ * Fills the shared memory segment id with samples for shmtest().
+ */
+int shmchild(word id) {
+	word *samples = shm_attach(id);
+	int i;
+	if(NULL == samples) {
+		return EXIT_FAILURE;
+	}
+	for(i = 0; i < 256; i++) {
+		samples[i] = i;
+	}
+	shm_detach(id);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * A child fills a block of samples in shared memory and the parent reads
+ * them in place after it exits.
+ */
+void shmtest() {
+	int id = shm_create(256*sizeof(word));
+	word *samples = shm_attach(id);
+	int i, status = EXIT_FAILURE;
+	if(NULL == samples) {
+		printf("shmtest failed\n\r");
+		return;
+	}
+	waitpid(spawn(shmchild, id, 0), &status);
+	for(i = 0; i < 256 && EXIT_SUCCESS == status; i++) {
+		if(samples[i] != i) {
+			status = EXIT_FAILURE;
+		}
+	}
+	if(EXIT_SUCCESS != status) {
+		printf("shmtest failed\n\r");
+	}
+	shm_detach(id);
+}
+
+/* Messages sent in each message queue benchmark. */
+#define MQBENCH_MSGS 1000
+
+/*
+ * Receives MQBENCH_MSGS messages from the queue id.
+ */
+int mqsink(word id) {
+	char buf[64];
+	int i;
+	for(i = 0; i < MQBENCH_MSGS; i++) {
+		mq_recv(id, buf, WAIT_FOREVER);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Sends back every message from the queue in the low half of ids on the
+ * queue in the high half.
+ */
+int mqecho(word ids) {
+	char buf[64];
+	int i;
+	for(i = 0; i < MQBENCH_MSGS; i++) {
+		mq_recv(ids & 0xFFFF, buf, WAIT_FOREVER);
+		mq_send(ids >> 16, buf, WAIT_FOREVER);
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Prints the cycles per message it takes to stream messages of size bytes
+ * to another process, and the cycles for a round trip through two queues.
+ */
+void mqbench(word size) {
+	char buf[64];
+	int i, pid;
+	int to = mq_create(size, 8);
+	int from = mq_create(size, 8);
+	word start, stream, roundtrip;
+	if(-1 == to || -1 == from) {
+		printf("mqbench failed\n\r");
+		return;
+	}
+	pid = spawn(mqsink, to, 0);
+	start = cycles();
+	for(i = 0; i < MQBENCH_MSGS; i++) {
+		mq_send(to, buf, WAIT_FOREVER);
+	}
+	wait(pid);
+	stream = cycles() - start;
+	pid = spawn(mqecho, to | from << 16, 0);
+	start = cycles();
+	for(i = 0; i < MQBENCH_MSGS; i++) {
+		mq_send(to, buf, WAIT_FOREVER);
+		mq_recv(from, buf, WAIT_FOREVER);
+	}
+	roundtrip = cycles() - start;
+	wait(pid);
+	printf("%i byte messages: %i cycles each, %i cycles round trip\n\r", \
+			size, stream / MQBENCH_MSGS, roundtrip / MQBENCH_MSGS);
+	mq_destroy(to);
+	mq_destroy(from);
+}
+
+/*
+ * Server for rpctest(). Replies to every message with its first word plus
+ * one, until it gets a 0.
+ */
+int rpcserver(word arg) {
+	word msg;
+	int client;
+	do {
+		client = receive(&msg, sizeof(msg));
+		msg++;
+		reply(client, &msg, sizeof(msg));
+	} while(1 != msg);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Prints the cycles it takes for a send to a server process and its reply.
+ */
+void rpctest() {
+	int i;
+	int pid = spawn(rpcserver, 0, 0);
+	word msg, start, rpc;
+	if(-1 == pid) {
+		printf("rpctest failed\n\r");
+		return;
+	}
+	start = cycles();
+	for(i = 0; i < MQBENCH_MSGS; i++) {
+		msg = i + 1;
+		if(sizeof(msg) != send(pid, &msg, sizeof(msg)) || i + 2 != msg) {
+			printf("rpctest failed\n\r");
+			break;
+		}
+	}
+	rpc = cycles() - start;
+	msg = 0;
+	send(pid, &msg, sizeof(msg));
+	wait(pid);
+	printf("send/receive/reply: %i cycles\n\r", rpc / MQBENCH_MSGS);
+}
+
+/* Items passed in each ring benchmark, and the size of the ring. */
+#define RINGTEST_ITEMS 4096
+#define RINGTEST_SIZE 64
+
+/*
+ * Consumer for ringtest(). Takes RINGTEST_ITEMS items from the ring in the
+ * shared memory segment id and checks that they come in order.
+ */
+int ringconsumer(word id) {
+	struct ring *r = shm_attach(id);
+	word i, item;
+	if(NULL == r) {
+		return EXIT_FAILURE;
+	}
+	for(i = 0; i < RINGTEST_ITEMS; i++) {
+		while(-1 == ring_get(r, &item)) {
+			ring_wait(r, WAIT_FOREVER);
+		}
+		if(item != i) {
+			break;
+		}
+	}
+	shm_detach(id);
+	return i == RINGTEST_ITEMS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Prints the cycles per item to put and take items from a ring in the same
+ * process, and to stream them through shared memory to a consumer process
+ * that waits when the ring is empty.
+ */
+void ringtest() {
+	int id = shm_create(RING_BYTES(RINGTEST_SIZE));
+	struct ring *r = shm_attach(id);
+	int pid, status = EXIT_FAILURE;
+	word i, item, start, local, stream;
+	if(NULL == r) {
+		printf("ringtest failed\n\r");
+		return;
+	}
+	ring_init(r, RINGTEST_SIZE);
+	start = cycles();
+	for(i = 0; i < RINGTEST_ITEMS; i++) {
+		ring_put(r, i);
+		ring_get(r, &item);
+	}
+	local = cycles() - start;
+	pid = spawn(ringconsumer, id, 0);
+	start = cycles();
+	for(i = 0; i < RINGTEST_ITEMS && -1 != pid; i++) {
+		while(-1 == (status = ring_put(r, i))) {
+			yield();
+		}
+		if(1 == status) {
+			ring_wake(r);
+		}
+	}
+	if(-1 == pid || -1 == waitpid(pid, &status) || EXIT_SUCCESS != status) {
+		printf("ringtest failed\n\r");
+	}
+	else {
+		stream = cycles() - start;
+		printf("ring: %i cycles per item, %i cycles streamed\n\r", \
+				local / RINGTEST_ITEMS, stream / RINGTEST_ITEMS);
+	}
+	shm_detach(id);
+}
+
+/* Lock and unlock pairs timed by synctest(). */
+#define SYNCTEST_LOCKS 1000
+
+/*
+ * Child of synctest(). Takes the mutex and posts the semaphore the shell is
+ * waiting on. The shell then blocks on the mutex, and the child has to be
+ * running at the shell's priority until it unlocks it.
+ */
+int syncchild(word arg) {
+	int inherited;
+	mutex_lock(arg >> 16);
+	sem_post(arg & 0xFFFF);
+/* The shell runs first and blocks on the mutex. */
+	inherited = getpriority(syncpage->pid);
+	mutex_unlock(arg >> 16);
+	return inherited == getpriority(INITPID) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * The shell blocks on a mutex held by a lower priority child, which should
+ * raise the child to the shell's priority until it unlocks the mutex. Then
+ * prints the cycles for an uncontended lock and unlock, which never enter
+ * the kernel.
+ */
+void synctest() {
+	int sem = sem_create(0);
+	int mutex = mutex_create();
+	int priority = getpriority(INITPID);
+	int i, pid, status = EXIT_FAILURE;
+	word start, locks;
+	if(-1 == sem || -1 == mutex || PRIO_MIN == priority) {
+		printf("synctest failed\n\r");
+		return;
+	}
+	pid = spawn(syncchild, sem | mutex << 16, 0);
+	if(-1 != pid) {
+		setpriority(pid, priority - 1);
+		sem_wait(sem);
+		mutex_lock(mutex);
+		mutex_unlock(mutex);
+		waitpid(pid, &status);
+	}
+	start = cycles();
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		mutex_lock(mutex);
+		mutex_unlock(mutex);
+	}
+	locks = cycles() - start;
+	if(EXIT_SUCCESS != status || priority != getpriority(INITPID)) {
+		printf("synctest failed\n\r");
+	}
+	else {
+		printf("mutex: %i cycles to lock and unlock\n\r", \
+				locks / SYNCTEST_LOCKS);
+	}
+	mutex_destroy(mutex);
+	sem_destroy(sem);
+}
+
+/* Data shared by futextest() and futexchild(). */
+struct futexshared {
+	struct umutex lock;
+	word count;
+};
+
+/*
+ * Child of futextest(). Adds SYNCTEST_LOCKS to the count in the shared
+ * memory segment id, one at a time with the lock held.
+ */
+int futexchild(word id) {
+	struct futexshared *shared = shm_attach(id);
+	int i;
+	if(NULL == shared) {
+		return EXIT_FAILURE;
+	}
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		umutex_lock(&shared->lock);
+		shared->count++;
+		umutex_unlock(&shared->lock);
+	}
+	shm_detach(id);
+	return EXIT_SUCCESS;
+}
+
+/*
+ * The shell and a child add to a count in shared memory under a futex
+ * mutex, which checks that they never both hold it. Then prints the cycles
+ * for an uncontended lock and unlock, against the two system calls that a
+ * mutex in the kernel would need.
+ */
+void futextest() {
+	int id = shm_create(sizeof(struct futexshared));
+	struct futexshared *shared = shm_attach(id);
+	struct umutex m;
+	int i, pid, status = EXIT_FAILURE;
+	word start, locks, svcs;
+	if(NULL == shared) {
+		printf("futextest failed\n\r");
+		return;
+	}
+	umutex_init(&shared->lock);
+	shared->count = 0;
+	if(-1 != (pid = spawn(futexchild, id, 0))) {
+		for(i = 0; i < SYNCTEST_LOCKS; i++) {
+			umutex_lock(&shared->lock);
+			shared->count++;
+			umutex_unlock(&shared->lock);
+		}
+		waitpid(pid, &status);
+	}
+	if(EXIT_SUCCESS != status || 2*SYNCTEST_LOCKS != shared->count) {
+		printf("futextest failed\n\r");
+		shm_detach(id);
+		return;
+	}
+	shm_detach(id);
+	umutex_init(&m);
+	start = cycles();
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		umutex_lock(&m);
+		umutex_unlock(&m);
+	}
+	locks = cycles() - start;
+/* Waking nobody is about the cheapest system call there is. */
+	start = cycles();
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		futex_wake(&m.state, 0);
+		futex_wake(&m.state, 0);
+	}
+	svcs = cycles() - start;
+	printf("futex mutex: %i cycles to lock and unlock, %i with svc\n\r", \
+			locks / SYNCTEST_LOCKS, svcs / SYNCTEST_LOCKS);
+}
+
+/*
+ * Child of notifytest(). Answers each notification from the shell with one
+ * of its own, then waits for both of the last two bits at once.
+ */
+int notifychild(word arg) {
+	int i;
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		wait_bits(0x1, WAIT_FOREVER);
+		notify(INITPID, 0x1);
+	}
+	if(0x6 != wait_bits(0x6 | WAIT_ALL, WAIT_FOREVER)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Prints the cycles for a notification to a child and one back. The child
+ * then has to see two bits that are set one at a time, and the shell has to
+ * time out waiting for a bit that nobody sets.
+ */
+void notifytest() {
+	int i, status = EXIT_FAILURE;
+	int pid = spawn(notifychild, 0, 0);
+	word start, roundtrip;
+	if(-1 == pid) {
+		printf("notifytest failed\n\r");
+		return;
+	}
+	start = cycles();
+	for(i = 0; i < SYNCTEST_LOCKS; i++) {
+		notify(pid, 0x1);
+		wait_bits(0x1, WAIT_FOREVER);
+	}
+	roundtrip = cycles() - start;
+	notify(pid, 0x2);
+	notify(pid, 0x4);
+	waitpid(pid, &status);
+	if(EXIT_SUCCESS != status || TIMEDOUT != wait_bits(0x8, 10)) {
+		printf("notifytest failed\n\r");
+		return;
+	}
+	printf("notify: %i cycles round trip\n\r", roundtrip / SYNCTEST_LOCKS);
+}
+
+/* Bytes pipetest() sends through its pipeline. */
+#define PIPETEST_BYTES 4096
+
+/*
+ * Producer for pipetest(). Writes PIPETEST_BYTES lower case letters to fd.
+ */
+void pipeproducer(int fd) {
+	char buf[32];
+	int i, n, len;
+	for(i = 0; i < PIPETEST_BYTES; i += n) {
+		len = PIPETEST_BYTES - i < sizeof(buf) ? PIPETEST_BYTES - i : sizeof(buf);
+		for(n = 0; n < len; n++) {
+			buf[n] = 'a' + (i + n) % 26;
+		}
+		if(-1 == (n = write(fd, buf, len))) {
+			exit(EXIT_FAILURE);
+		}
+	}
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * Filter for pipetest(). Copies from in to out in upper case until in has
+ * no writers left.
+ */
+void pipefilter(int in, int out) {
+	char buf[32];
+	int i, n, m;
+	while(0 < (n = read(in, buf, sizeof(buf)))) {
+		for(i = 0; i < n; i++) {
+			buf[i] -= 'a' - 'A';
+		}
+		for(i = 0; i < n; i += m) {
+			if(-1 == (m = write(out, buf + i, n - i))) {
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * A producer, a filter and the shell connected by two pipes. Both children
+ * are forked, so they get the pipes through their file descriptors, and
+ * close the ends they don't use so that the end of each pipe is seen. The
+ * shell checks what comes out and prints the cycles each byte takes to get
+ * through.
+ */
+void pipetest() {
+	int in[2], out[2];
+	int pids[2];
+	char buf[32];
+	int i, n, total = 0, ok = 1;
+	word start;
+	if(-1 == pipe(in)) {
+		printf("pipetest failed\n\r");
+		return;
+	}
+	if(-1 == pipe(out)) {
+		close(in[0]);
+		close(in[1]);
+		printf("pipetest failed\n\r");
+		return;
+	}
+	start = cycles();
+	if(NULLPID == (pids[0] = fork())) {
+		close(in[0]);
+		close(out[0]);
+		close(out[1]);
+		pipeproducer(in[1]);
+	}
+	if(NULLPID == (pids[1] = fork())) {
+		close(in[1]);
+		close(out[0]);
+		pipefilter(in[0], out[1]);
+	}
+	close(in[0]);
+	close(in[1]);
+	close(out[1]);
+	while(0 < (n = read(out[0], buf, sizeof(buf)))) {
+		for(i = 0; i < n; i++) {
+			if(buf[i] != 'A' + (total + i) % 26) {
+				ok = 0;
+			}
+		}
+		total += n;
+	}
+	start = cycles() - start;
+	close(out[0]);
+	for(i = 0; i < 2; i++) {
+		if(-1 != pids[i]) {
+			wait(pids[i]);
+		}
+	}
+	if(!ok || PIPETEST_BYTES != total) {
+		printf("pipetest failed\n\r");
+		return;
+	}
+	printf("pipe: %i cycles per byte through a filter\n\r", \
+			start / PIPETEST_BYTES);
+}
+
+/*
+ * Shell command that prints how much of its stack every process has used at
+ * most. A process that has used all of it has likely overflowed.
+ */
+void stacks() {
+	int pid, used;
+	word size;
+	for(pid = 0; pid < MAX_PROC; pid++) {
+		if(-1 == (used = stackuse(pid, &size))) {
+			continue;
+		}
+		printf("pid %i: %i of %i bytes", pid, used, size);
+		if(used == size) {
+			printf(" overflowed");
+		}
+		printf("\n\r");
+	}
+}
+
+/*
+ * Shell command that prints how the kernel is using ram, how much is left,
+ * and what each process is using.
+ */
+void mem() {
+	struct meminfo info;
+	int pid;
+	meminfo(ANYPID, &info);
+	printf("kernel: %i bytes (data %i, bss %i, heap %i/%i, stack %i)\n\r", \
+			info.kram, info.data, info.bss, info.kheapused, info.kheap, info.kstack);
+	printf("free: %i bytes, largest block %i\n\r", info.ramfree, info.largest);
+	for(pid = 0; pid < MAX_PROC; pid++) {
+		if(-1 == meminfo(pid, &info)) {
+			continue;
+		}
+		printf("pid %i: stack %i/%i, heap %i, shm %i\n\r", pid, \
+				info.stackpeak, info.stack, info.heap, info.shm);
+	}
+}
+
 /* 
  * This function tests reading and writing flash by writing the testwrite
  * struct into flash memory, and then reading it back and comparing the
@@ -162,6 +917,21 @@ int smain() {
 /* Commented out to reduce flash writes while testing. */
 	//wrflash();
   stringtest();
+  sleeptest();
+  spawntest();
+  fairtest();
+  heaptest();
+  shmtest();
+  mqbench(4);
+  mqbench(64);
+  rpctest();
+  ringtest();
+  synctest();
+  futextest();
+  notifytest();
+  pipetest();
+  stacks();
+  mem();
   forktest();
 	return 0;
 }
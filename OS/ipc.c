@@ -0,0 +1,358 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : ipc.c                                                           *
+ * Synopsis : Interprocess communication                                      *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <types.h>
+#include <proc.h>
+#include <mem.h> /* For kmalloc() and get_ram() */
+#include <cstring.h> /* For memcpy() */
+#include <ipc.h>
+
+/* Message queues, NULL where there is none. */
+static struct mq *mqtable[NMQ];
+/* Consumers waiting for a ring to have an item. ipcbuf is the ring. */
+static struct waitq ringwaiters;
+/* Processes waiting in syswaitbits(). notewait is what they wait for. */
+static struct waitq notifyq;
+
+/* Address of slot i of mq. */
+#define slot(mq, i) ((void *)((mq)->buf + ((i) % (mq)->nslots)*(mq)->msgsize))
+
+/*
+ * Initialize the ipc objects.
+ */
+void init_ipc() {
+	int i;
+	for(i = 0; i < NMQ; i++) {
+		mqtable[i] = NULL;
+	}
+	ringwaiters.head = NULL;
+	notifyq.head = NULL;
+}
+
+/* Returns message queue id, or NULL if there is no such queue. */
+static struct mq *mqid(int id) {
+	if(id < 0 || id >= NMQ) {
+		return NULL;
+	}
+	return mqtable[id];
+}
+
+/*
+ * Create a message queue that holds nslots messages of msgsize bytes.
+ * Returns the id of the queue, or -1 on failure.
+ */
+int sysmqcreate(word msgsize, word nslots) {
+	struct mq *mq;
+	int id;
+	for(id = 0; id < NMQ && NULL != mqtable[id]; id++);
+	if(id >= NMQ || 0 == msgsize || 0 == nslots ||
+	   nslots > (SRAM_ - _SRAM) / msgsize) {
+		return -1;
+	}
+	if(NULL == (mq = kmalloc(sizeof(struct mq)))) {
+		return -1;
+	}
+	if(0 == (mq->buf = get_ram(msgsize*nslots))) {
+		kfree(mq, sizeof(struct mq));
+		return -1;
+	}
+	mq->msgsize = msgsize;
+	mq->nslots = nslots;
+	mq->head = mq->count = 0;
+	mq->senders.head = mq->receivers.head = NULL;
+	mqtable[id] = mq;
+	return id;
+}
+
+/*
+ * Destroy the message queue id. Processes blocked on it return -1. Returns 0
+ * on success, -1 if there is no such queue.
+ */
+int sysmqdestroy(int id) {
+	struct mq *mq = mqid(id);
+	struct pcb *p;
+	if(NULL == mq) {
+		return -1;
+	}
+	while(NULL != (p = wakeone(&mq->senders))) {
+		setreturn(p, -1);
+	}
+	while(NULL != (p = wakeone(&mq->receivers))) {
+		setreturn(p, -1);
+	}
+	free_ram(mq->buf, mq->msgsize*mq->nslots);
+	kfree(mq, sizeof(struct mq));
+	mqtable[id] = NULL;
+	return 0;
+}
+
+/*
+ * Send the message at msg to the queue id. If a receiver is waiting, the
+ * message is copied straight to it and it runs next. If the queue is full
+ * the caller waits up to timeout ms for a slot, WAIT_FOREVER to wait as long
+ * as it takes or 0 not to wait at all. Returns 0 on success, TIMEDOUT if
+ * there was no room in time, or -1 if there is no such queue or msg isn't in
+ * the caller's memory.
+ */
+int sysmqsend(int id, void *msg, word timeout) {
+	struct mq *mq = mqid(id);
+	struct pcb *p;
+	if(NULL == mq || !checkuser(currproc(), (word)msg, mq->msgsize)) {
+		return -1;
+	}
+	if(NULL != (p = wakeone(&mq->receivers))) {
+		memcpy((void *)p->ipcbuf, msg, mq->msgsize);
+		setreturn(p, mq->msgsize);
+		handoff(p);
+		return 0;
+	}
+	if(mq->count < mq->nslots) {
+		memcpy(slot(mq, mq->head + mq->count), msg, mq->msgsize);
+		mq->count++;
+		return 0;
+	}
+	if(0 == timeout) {
+		return TIMEDOUT;
+	}
+/* recv will take the message from here when there is room, and set the */
+/* return value. */
+	p = currproc();
+	p->ipcbuf = (word)msg;
+	sleepfor(&mq->senders, BLOCKED, timeout);
+	return TIMEDOUT;
+}
+
+/*
+ * Receive the oldest message from the queue id into buf, which must have
+ * room for a whole message. If the queue is empty the caller waits up to
+ * timeout ms for one, the same as sysmqsend(). Returns the size of the
+ * message, TIMEDOUT if none came in time, or -1 if there is no such queue or
+ * buf isn't in the caller's memory.
+ */
+int sysmqrecv(int id, void *buf, word timeout) {
+	struct mq *mq = mqid(id);
+	struct pcb *p;
+	if(NULL == mq || !checkuser(currproc(), (word)buf, mq->msgsize)) {
+		return -1;
+	}
+	if(mq->count > 0) {
+		memcpy(buf, slot(mq, mq->head), mq->msgsize);
+		mq->head = (mq->head + 1) % mq->nslots;
+		mq->count--;
+/* Make room for a sender that was waiting. */
+		if(NULL != (p = wakeone(&mq->senders))) {
+			memcpy(slot(mq, mq->head + mq->count), (void *)p->ipcbuf, mq->msgsize);
+			mq->count++;
+			setreturn(p, 0);
+		}
+		return mq->msgsize;
+	}
+	if(0 == timeout) {
+		return TIMEDOUT;
+	}
+	p = currproc();
+	p->ipcbuf = (word)buf;
+	sleepfor(&mq->receivers, BLOCKED, timeout);
+	return TIMEDOUT;
+}
+
+/* Bytes to copy between buffers of size a and b. */
+#define msgsize(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+ * Send the size bytes at msg to the process belonging to pid and wait for it
+ * to reply. The reply is written over msg, up to size bytes. If the receiver
+ * is already waiting in sysreceive(), the message is copied straight from the
+ * sender's stack to the receiver's and the receiver runs next. Otherwise the
+ * sender waits in the receiver's senders queue. Returns the number of bytes
+ * in the reply, or -1 on failure.
+ */
+int syssend(int pid, void *msg, word size) {
+	struct pcb *client = currproc();
+	struct pcb *server = pidproc(pid);
+	if(NULL == server || server == client || ZOMBIE == server->state ||
+	   !checkuser(client, (word)msg, size)) {
+		return -1;
+	}
+	client->ipcbuf = (word)msg;
+	client->ipcsize = size;
+	client->ipcpid = pid;
+	if(RECEIVE_BLOCKED == server->state) {
+		memcpy((void *)server->ipcbuf, msg, msgsize(size, server->ipcsize));
+		setreturn(server, client->pid);
+		server->state = RUNNABLE;
+		enqueue(server);
+		handoff(server);
+		dequeue(client);
+		client->state = REPLY_BLOCKED;
+	}
+	else {
+		sleepon(&server->senders, SEND_BLOCKED);
+	}
+	return -1;
+}
+
+/*
+ * Receive a message into buf, up to size bytes, waiting for one if no
+ * process has sent one yet. The sender waits for sysreply(). Returns the pid
+ * of the sender, or -1 if buf isn't in the caller's memory.
+ */
+int sysreceive(void *buf, word size) {
+	struct pcb *server = currproc();
+	struct pcb *client = server->senders.head;
+	if(!checkuser(server, (word)buf, size)) {
+		return -1;
+	}
+	if(NULL != client) {
+		unblock(client);
+		memcpy(buf, (void *)client->ipcbuf, msgsize(size, client->ipcsize));
+		client->state = REPLY_BLOCKED;
+		return client->pid;
+	}
+	server->ipcbuf = (word)buf;
+	server->ipcsize = size;
+	dequeue(server);
+	server->state = RECEIVE_BLOCKED;
+	return -1;
+}
+
+/*
+ * Reply to the process belonging to pid with the size bytes at msg. The
+ * reply is copied straight to the sender's buffer, and the sender runs next.
+ * Returns 0 on success, -1 if pid isn't waiting for a reply from the caller
+ * or msg isn't in the caller's memory.
+ */
+int sysreply(int pid, void *msg, word size) {
+	struct pcb *server = currproc();
+	struct pcb *client = pidproc(pid);
+	if(NULL == client || REPLY_BLOCKED != client->state ||
+	   server->pid != client->ipcpid || !checkuser(server, (word)msg, size)) {
+		return -1;
+	}
+	size = msgsize(size, client->ipcsize);
+	memcpy((void *)client->ipcbuf, msg, size);
+	setreturn(client, size);
+	client->state = RUNNABLE;
+	enqueue(client);
+	handoff(client);
+	return 0;
+}
+
+/*
+ * Fail the sends that are waiting on p, since it is exiting and will never
+ * receive or reply to them.
+ */
+void ipc_exit(struct pcb *p) {
+	extern struct pcb ptable[];
+	struct pcb *client;
+	int i;
+	while(NULL != (client = wakeone(&p->senders))) {
+		setreturn(client, -1);
+	}
+	for(i = 0; i < MAX_PROC; i++) {
+		client = ptable + i;
+		if(REPLY_BLOCKED == client->state && p->pid == client->ipcpid) {
+			setreturn(client, -1);
+			client->state = RUNNABLE;
+			enqueue(client);
+		}
+	}
+}
+
+/*
+ * Wait up to timeout ms for the ring r to have an item. Returns 0 when it
+ * has one, TIMEDOUT, or -1 if r isn't in the caller's memory.
+ */
+int sysringwait(struct ring *r, word timeout) {
+	if(!checkuser(currproc(), (word)r, sizeof(struct ring))) {
+		return -1;
+	}
+	if(0 != ring_count(r)) {
+		return 0;
+	}
+	if(0 == timeout) {
+		return TIMEDOUT;
+	}
+	currproc()->ipcbuf = (word)r;
+	sleepfor(&ringwaiters, BLOCKED, timeout);
+	return TIMEDOUT;
+}
+
+/*
+ * Wake up the consumer of the ring r if it is waiting in sysringwait(). The
+ * producer calls this when ring_put() returns 1. Interrupt handlers can call
+ * it too, followed by reschedule(), as long as their priority is between the
+ * systick's and PendSV's so that they can't interrupt the kernel. Returns 0.
+ */
+int sysringwake(struct ring *r) {
+	struct pcb *p;
+	for(p = ringwaiters.head; NULL != p; p = p->qnext) {
+		if((word)r == p->ipcbuf) {
+			setreturn(p, 0);
+			wakeproc(p);
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Returns the bits of notified that satisfy the wait_bits() mask, or 0 if
+ * they don't satisfy it yet.
+ */
+static word notebits(word notified, word mask) {
+	word bits = notified & mask & NOTIFY_BITS;
+	if(mask & WAIT_ALL) {
+		return bits == (mask & NOTIFY_BITS) ? bits : 0;
+	}
+	return bits;
+}
+
+/*
+ * Set bits in the notification word of the process belonging to pid, and
+ * wake it up if it is waiting for them. Nothing is allocated or queued, so
+ * this is the cheapest way to signal one process. Interrupt handlers can
+ * call it, followed by reschedule(), under the same rules as sysringwake().
+ * Returns 0 on success, -1 if there is no such process.
+ */
+int sysnotify(int pid, word bits) {
+	struct pcb *p = pidproc(pid);
+	word got;
+	if(NULL == p || UNUSED == p->state || ZOMBIE == p->state) {
+		return -1;
+	}
+	p->notified |= bits & NOTIFY_BITS;
+	if(&notifyq == p->waitq && 0 != (got = notebits(p->notified, p->notewait))) {
+		p->notified &= ~got;
+		setreturn(p, got);
+		wakeproc(p);
+	}
+	return 0;
+}
+
+/*
+ * Wait up to timeout ms for any of the bits in mask to be set in the
+ * caller's notification word, or all of them if mask has WAIT_ALL. Returns
+ * the bits of mask that were set, which are cleared, TIMEDOUT, or -1 if mask
+ * has no bits.
+ */
+int syswaitbits(word mask, word timeout) {
+	struct pcb *p = currproc();
+	word got;
+	if(0 == (mask & NOTIFY_BITS)) {
+		return -1;
+	}
+	if(0 != (got = notebits(p->notified, mask))) {
+		p->notified &= ~got;
+		return got;
+	}
+	if(0 == timeout) {
+		return TIMEDOUT;
+	}
+	p->notewait = mask;
+	sleepfor(&notifyq, BLOCKED, timeout);
+	return TIMEDOUT;
+}
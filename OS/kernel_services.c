@@ -7,8 +7,13 @@
 #include <proc.h>
 #include <types.h>
 #include <cstring.h>
-#include <mem.h> /* in sysexit(), for free_stackspace() */
+#include <mem.h> /* in sysexit(), for free_ram() */
 #include <hw.h> /* for write_flash() */
+#include <clock.h> /* for timer_add() */
+#include <kernel_services.h>
+#include <ipc.h> /* in sysexit(), for ipc_exit() */
+#include <sync.h> /* for sync_exit() and lockpriority() */
+#include <file.h> /* for file_fork() and file_exit() */
 
 /*
  * IMPORTANT:
@@ -17,92 +22,466 @@
  */
 
 /* From proc.c */
-extern int maxpid;
 extern struct pcb ptable[];
+/* From mem.c */
+extern struct shm *shmtable[];
 
 /*
  * Write memory that starts at saddr and ends at eaddr to flash address faddr.
  * returns 0 on success, -1 otherwise.
  */
 int sysflash(void *saddr, void *eaddr, void *faddr) {
+  if(eaddr < saddr ||
+     !checkuser(currproc(), (word)saddr, (word)eaddr - (word)saddr)) {
+    return -1;
+  }
   return write_flash(saddr, eaddr, faddr);
 }
 
 /*
  * Creates a new process. The parent forks the child. parent returns the pid
  * of the new process, child returns NULLPID. Returns -1 on failure.
+ * tf and ctx are the registers the parent entered the kernel with. The child
+ * gets a copy of the parents stack and registers, and starts by returning
+ * from the same system call. The child shares the parent's open files, but
+ * does not get the parent's heap.
  */
-int sysfork() {
-	struct pcb *child = reserveproc(NULL);
+int sysfork(struct trapframe *tf, struct context *ctx) {
+	struct pcb *parent = currproc();
+/* The same usable stack as the parent, so the child's block is the same size. */
+	struct pcb *child = reserveproc(NULL, parent->stacksize - stackguard(parent));
 	if(NULL == child) {
 		return -1;
 	}
-	struct pcb *parent = currproc();
   parent->numchildren++;
-	child->context.pc = parent->context.pc;
-/* Number of bytes being used in the parent stack */
-  word pstackuse = stacktop(parent->rampg) - parent->context.sp;
+/* Number of bytes being used in the parent stack, including the trapframe */
+  word pstackuse = stacktop(parent) - (word)tf;
+/* The registers that aren't in the trapframe, and s16-s31 if the parent was */
+/* using the fpu. */
+  word ctxsize = sizeof(struct context);
+  if(!(ctx->lr & EXC_RETURN_NOFPU)) {
+    ctxsize += 16*sizeof(word);
+  }
 /* Copy the parent's stack */
   memcpy(
-      (void *)(stacktop(child->rampg) - pstackuse),
-      (void *)(stacktop(parent->rampg) - pstackuse),
+      (void *)(stacktop(child) - pstackuse),
+      (void *)(stacktop(parent) - pstackuse),
       pstackuse 
   );
-/* Adjust the stack pointer of the child to the same offset as the parent. */
-  child->context.sp -= pstackuse;
+/* Put the registers under the copied trapframe, where swtch() expects them. */
+  child->context = (struct context *)
+    (stacktop(child) - pstackuse - ctxsize);
+  memcpy(child->context, ctx, ctxsize);
+/* r7 is the frame pointer. Move it to the same offset in the child's stack. */
+  if(ctx->r7 <= stacktop(parent) && ctx->r7 >= (word)tf) {
+    child->context->r7 = ctx->r7 - stacktop(parent) +
+      stacktop(child);
+  }
 	child->ppid = parent->pid;
+	child->sibling = parent->child;
+	parent->child = child;
+	child->priority = child->basepriority = parent->basepriority;
+	file_fork(parent, child);
 /* Child will return NULLPID to the user process. */
-	child->context.r0 = NULLPID;
+	trapframe(child)->r0 = NULLPID;
+	enqueue(child);
+	return child->pid;
+}
+
+/*
+ * Free a ZOMBIE child, giving its exit status to the parent at the address
+ * the parent asked for in syswait(). Returns the pid of the child.
+ */
+static int reap(struct pcb *child) {
+	struct pcb *parent = ptable + child->ppid;
+	struct pcb **link = &parent->child;
+	int pid = child->pid;
+	if(NULL != parent->waitstatus) {
+		*parent->waitstatus = child->exitstatus;
+	}
+	while(*link != child) {
+		link = &(*link)->sibling;
+	}
+	*link = child->sibling;
+	parent->numchildren--;
+	freeproc(child);
+	return pid;
+}
+
+/*
+ * Give an orphaned child to initshell. If initshell is gone too, the child
+ * is freed as soon as it exits.
+ */
+static void adopt(struct pcb *child) {
+	struct pcb *init = pidproc(INITPID);
+	if(NULL == init || init == currproc()) {
+		child->ppid = NULLPID;
+		child->sibling = NULL;
+		return;
+	}
+	child->ppid = INITPID;
+	child->sibling = init->child;
+	init->child = child;
+	init->numchildren++;
+}
+
+/*
+ * Creates a new process that starts in the function at fn with arg as its
+ * argument, on a fresh stack of at least stacksize bytes. Unlike sysfork()
+ * nothing is copied from the parent. When fn returns the process exits with
+ * the returned value. A stacksize of 0 gets the default STACK_SIZE. Returns
+ * the pid of the new process, or -1 on failure or if stacksize is more than
+ * all of the ram.
+ */
+int sysspawn(word fn, word arg, word stacksize) {
+	struct pcb *parent = currproc();
+	struct pcb *child;
+	if(0 == stacksize) {
+		stacksize = STACK_SIZE;
+	}
+	if(stacksize > SRAM_ - _SRAM) {
+		return -1;
+	}
+	if(NULL == (child = reserveproc(NULL, stacksize))) {
+		return -1;
+	}
+	initcontext(child, fn, arg);
+	parent->numchildren++;
+	child->ppid = parent->pid;
+	child->sibling = parent->child;
+	parent->child = child;
+	child->priority = child->basepriority = parent->basepriority;
+	enqueue(child);
 	return child->pid;
 }
 
 /*
- * The calling process waits for the process belonging to pid to exit (become
- * un-used). The scheduler handles the stopping and starting of waiting
- * processes.
+ * The calling process waits for its child belonging to pid to exit, or for
+ * any of its children to exit if pid is ANYPID. If the child has already
+ * exited it is reaped right away. Otherwise the caller is taken off the ready
+ * queues, and sysexit() reaps the child into it and makes it ready again.
+ * The exit status of the child is put at status unless it is NULL. Returns
+ * the pid of the child that was reaped, or -1 if there is nothing to wait for
+ * or status isn't in the caller's memory.
  */
-int syswait(int pid) {
+int syswait(int pid, int *status) {
 	struct pcb *waiting = currproc();
-	waiting->state = WAITING;
+	struct pcb *child;
+	if(NULL != status && !checkuser(waiting, (word)status, sizeof(int))) {
+		return -1;
+	}
+	waiting->waitstatus = status;
+	if(ANYPID == pid) {
+		if(0 == waiting->numchildren) {
+			return -1;
+		}
+		for(child = waiting->child; NULL != child; child = child->sibling) {
+			if(ZOMBIE == child->state) {
+				return reap(child);
+			}
+		}
+		dequeue(waiting);
+		waiting->state = WAITING;
+	}
+	else if(NULL == (child = pidproc(pid)) || child->ppid != waiting->pid) {
+		return -1;
+	}
+	else if(ZOMBIE == child->state) {
+		return reap(child);
+	}
+	else {
+		sleepon(&child->waiters, WAITING);
+	}
 	waiting->waitpid = pid;
-	return 0;
+	return pid;
 }
 
 /*
  * Clears out the pcb of the process and notifies it's parent of the exit.
+ * The process stays a ZOMBIE holding exitcode until the parent reaps it,
+ * unless the parent was already waiting for it. Children that are still
+ * running are given to initshell, and children that have exited are reaped
+ * since nothing can wait for them anymore. The process is no longer ready, so
+ * the kernel switches away from it for good before returning to the user.
  */
 int sysexit(int exitcode) {
 	struct pcb *exitproc = currproc();
-	exitproc->context.pc = 0;
-	exitproc->context.sp = 0;
-	exitproc->context.lr = 0;
-	exitproc->context.r0 = 0;
+	struct pcb *parent = pidproc(exitproc->ppid);
+	struct pcb *child, *next;
 	int i;
-	if(maxpid == exitproc->pid) {
-		for(i = maxpid; i >= 0; i--) {
-			if(RUNNABLE == ptable[i].state || RESERVED == ptable[i].state) {
-				maxpid = i;
-				break;
-			}
+	dequeue(exitproc);
+	if(stackpeak(exitproc) == exitproc->stacksize - stackguard(exitproc)) {
+    printf("Process %d used all of its %d byte stack\n\r", exitproc->pid, \
+        exitproc->stacksize - stackguard(exitproc));
+	}
+	free_ram(exitproc->stack, exitproc->stacksize);
+/* There are never more than MPU_HEAPREGIONS heap regions to free. */
+	for(i = 0; i < MPU_HEAPREGIONS; i++) {
+		if(0 != exitproc->heap[i]) {
+			free_ram(exitproc->heap[i], exitproc->heapsize[i]);
+			exitproc->heap[i] = 0;
 		}
 	}
-	free_stackspace(exitproc->rampg);
-	exitproc->pid = NULLPID;
-/* If this process was the child of another, subtract it's number of children */
-	if(exitproc->ppid != NULLPID) {
-		pidproc(exitproc->ppid)->numchildren--;
+	for(i = 0; i < MPU_SHMREGIONS; i++) {
+		if(-1 != exitproc->shm[i]) {
+			sysshmdetach(exitproc->shm[i]);
+		}
 	}
-	exitproc->ppid = NULLPID;
-  exitproc->waitpid = NULLPID;
-  if(0 != exitproc->numchildren) {
-    printf("Parent with pid %d exited with children\n\r", exitproc->numchildren);
-  }
-  exitproc->state = UNUSED;
-	exitproc->initflag = 1;
-	strncpy(exitproc->name, "\0", 1);
-/* Return the exit code to the parent */
-  if(exitcode != 0) {
-    return 1;
-  }
-  return exitcode;
+	file_exit(exitproc);
+	ipc_exit(exitproc);
+	sync_exit(exitproc);
+	exitproc->exitstatus = exitcode;
+	for(child = exitproc->child; NULL != child; child = next) {
+		next = child->sibling;
+		if(ZOMBIE == child->state) {
+			freeproc(child);
+		}
+		else {
+			adopt(child);
+		}
+	}
+	exitproc->child = NULL;
+	exitproc->numchildren = 0;
+	if(NULL == parent) {
+		freeproc(exitproc);
+		return 0;
+	}
+	exitproc->state = ZOMBIE;
+	if(WAITING == parent->state &&
+	   (ANYPID == parent->waitpid || exitproc->pid == parent->waitpid)) {
+		parent->waitpid = NULLPID;
+		setreturn(parent, reap(exitproc));
+		wakeproc(parent);
+	}
+	return 0;
+}
+
+/*
+ * Set the scheduling priority of the process belonging to pid, which has to
+ * be the caller or one of its children. No process can be given a higher
+ * priority than the caller's own, so nothing can starve the processes above
+ * it. It keeps running at a higher priority it inherited through a mutex
+ * until it unlocks the mutex. Returns 0 on success, -1 if pid or priority is
+ * invalid or not allowed.
+ */
+int syssetpriority(int pid, int priority) {
+	struct pcb *caller = currproc();
+	if(pid < 0 || pid >= MAX_PROC || UNUSED == ptable[pid].state) {
+		return -1;
+	}
+	if(pid != caller->pid && caller->pid != ptable[pid].ppid) {
+		return -1;
+	}
+	if(priority < PRIO_MIN || priority > caller->basepriority) {
+		return -1;
+	}
+	ptable[pid].basepriority = priority;
+	changepriority(ptable + pid, lockpriority(ptable + pid));
+	return 0;
+}
+
+/*
+ * Return the scheduling priority of the process belonging to pid, or -1 if
+ * there is no such process.
+ */
+int sysgetpriority(int pid) {
+	if(pid < 0 || pid >= MAX_PROC || UNUSED == ptable[pid].state) {
+		return -1;
+	}
+	return ptable[pid].priority;
+}
+
+/*
+ * Put the calling process to sleep for at least ms milliseconds. Returns 0.
+ */
+int syssleep(word ms) {
+	struct pcb *sleeper = currproc();
+	if(0 == ms) {
+		return 0;
+	}
+	dequeue(sleeper);
+	sleeper->state = SLEEPING;
+/* The current tick is already partly over, so wait one more. */
+	timer_add(sleeper, mstoticks(ms) + 1);
+	return 0;
+}
+
+/*
+ * Give up the rest of the time slice. The kernel switches to the next ready
+ * process of the same priority, if there is one, before returning to the
+ * user. Returns 0.
+ */
+int sysyield() {
+	slice = 0;
+	return 0;
+}
+
+/*
+ * Returns the number of cpu cycles counted by the DWT cycle counter. It is
+ * not readable from unprivileged code. Wraps around every 2^32 cycles.
+ */
+word syscycles() {
+	return DWT_CYCCNT_R;
+}
+
+/*
+ * Returns the most bytes of its stack that the process belonging to pid has
+ * used, and puts the size of its stack in size unless size is NULL. The
+ * guard at the bottom of the stack is not counted in either. A process that
+ * has used all of its stack has run up against the guard. Returns -1 if
+ * there is no such process or size isn't in the caller's memory.
+ */
+int sysstackuse(int pid, word *size) {
+	struct pcb *p = pidproc(pid);
+	if(NULL == p || ZOMBIE == p->state) {
+		return -1;
+	}
+	if(NULL != size && !checkuser(currproc(), (word)size, sizeof(word))) {
+		return -1;
+	}
+	if(NULL != size) {
+		*size = p->stacksize - stackguard(p);
+	}
+	return stackpeak(p);
+}
+
+/*
+ * Grant the calling process a new region of ram of at least size bytes for
+ * its heap. Regions are not next to each other like a traditional break, so
+ * each one is a separate pool for the user's allocator. A process can have
+ * up to MPU_HEAPREGIONS of them, and they are freed when it exits. Returns
+ * the address of the region, or 0 on failure.
+ */
+word syssbrk(word size) {
+	struct pcb *p = currproc();
+	word addr;
+	int i;
+	for(i = 0; i < MPU_HEAPREGIONS && 0 != p->heap[i]; i++);
+	if(i >= MPU_HEAPREGIONS || 0 == size || 0 == (addr = get_ram(size))) {
+		return 0;
+	}
+	p->heap[i] = addr;
+	p->heapsize[i] = ramsize(size);
+	setregion(p, PROC_HEAPREGION + i, addr, p->heapsize[i]);
+	return addr;
+}
+
+/*
+ * Create a shared memory segment of at least size bytes, filled with 0, and
+ * attach it to the calling process. Returns the id of the segment for
+ * sysshmattach(), or -1 on failure.
+ */
+int sysshmcreate(word size) {
+	struct shm *seg;
+	int id;
+	for(id = 0; id < NSHM && NULL != shmtable[id]; id++);
+	if(id >= NSHM || 0 == size) {
+		return -1;
+	}
+	if(NULL == (seg = kmalloc(sizeof(struct shm)))) {
+		return -1;
+	}
+	if(0 == (seg->addr = get_ram(size))) {
+		kfree(seg, sizeof(struct shm));
+		return -1;
+	}
+	seg->size = ramsize(size);
+	seg->refs = 0;
+	memset((void *)seg->addr, 0, seg->size);
+	shmtable[id] = seg;
+	if(0 == sysshmattach(id)) {
+		free_ram(seg->addr, seg->size);
+		kfree(seg, sizeof(struct shm));
+		shmtable[id] = NULL;
+		return -1;
+	}
+	return id;
+}
+
+/*
+ * Give the calling process access to the shared memory segment id with one
+ * of its MPU regions. Attaching a segment that is already attached just
+ * returns it again. Returns the address of the segment, or 0 on failure.
+ */
+word sysshmattach(int id) {
+	struct pcb *p = currproc();
+	struct shm *seg;
+	int i, slot = -1;
+	if(id < 0 || id >= NSHM || NULL == (seg = shmtable[id])) {
+		return 0;
+	}
+	for(i = 0; i < MPU_SHMREGIONS; i++) {
+		if(id == p->shm[i]) {
+			return seg->addr;
+		}
+		if(-1 == slot && -1 == p->shm[i]) {
+			slot = i;
+		}
+	}
+	if(-1 == slot) {
+		return 0;
+	}
+	p->shm[slot] = id;
+	seg->refs++;
+	setregion(p, PROC_SHMREGION + slot, seg->addr, seg->size);
+	return seg->addr;
+}
+
+/*
+ * Take away the calling process's access to the shared memory segment id.
+ * The segment is freed once no process has it attached. Returns 0 on
+ * success, -1 if it wasn't attached.
+ */
+int sysshmdetach(int id) {
+	struct pcb *p = currproc();
+	struct shm *seg;
+	int i;
+	for(i = 0; i < MPU_SHMREGIONS && (id != p->shm[i] || -1 == id); i++);
+	if(i >= MPU_SHMREGIONS) {
+		return -1;
+	}
+	seg = shmtable[id];
+	p->shm[i] = -1;
+	setregion(p, PROC_SHMREGION + i, 0, 0);
+	if(0 == --seg->refs) {
+		free_ram(seg->addr, seg->size);
+		kfree(seg, sizeof(struct shm));
+		shmtable[id] = NULL;
+	}
+	return 0;
+}
+
+/*
+ * Put how the kernel is using ram and how much is free in info. If pid isn't
+ * ANYPID, what the process belonging to pid is using is put in info too.
+ * Returns 0 on success, -1 if there is no such process or info isn't in the
+ * caller's memory.
+ */
+int sysmeminfo(int pid, struct meminfo *info) {
+	struct pcb *p = NULL;
+	int i;
+	if(!checkuser(currproc(), (word)info, sizeof(struct meminfo))) {
+		return -1;
+	}
+	if(ANYPID != pid && (NULL == (p = pidproc(pid)) || ZOMBIE == p->state)) {
+		return -1;
+	}
+	raminfo(info);
+	info->stack = info->stackpeak = info->heap = info->shm = 0;
+	if(NULL == p) {
+		return 0;
+	}
+	info->stack = p->stacksize - stackguard(p);
+	info->stackpeak = stackpeak(p);
+	for(i = 0; i < MPU_HEAPREGIONS; i++) {
+		if(0 != p->heap[i]) {
+			info->heap += p->heapsize[i];
+		}
+	}
+	for(i = 0; i < MPU_SHMREGIONS; i++) {
+		if(-1 != p->shm[i]) {
+			info->shm += shmtable[p->shm[i]]->size;
+		}
+	}
+	return 0;
 }
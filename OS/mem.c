@@ -8,44 +8,289 @@
 #include <mem.h>
 #include <cstring.h>
 
-/* Array to determine what space in ram is being used. */
-/* Kernel stack usage is automatically determined at reset and stored on the */
-/* stack and retrieved with KRAM_USE. */
-int stackusage[SRAM_PAGES];
-
-/* Return the index of the ram space that is not being used, or -1 if there */
-/* is no space. */
-int get_stackspace() {
-/* Each element represents the top of the stack that will be used. 0 will */
-/* use from 0 to STACK_SIZE-1, 1 will use STACK_SIZE to 2*STACK_SIZE-1, etc. */
-	int i = 0;
-	while(stackusage[i]) {
-		i++;
-		if(i > SRAM_PAGES) {
-      printf("No available RAM for new stack\n\r");
-			return -1;
+/* Buddy allocator for the ram the kernel isn't using. A block of order n is */
+/* RAM_GRAIN << n bytes and starts at a multiple of its size from _SRAM, so */
+/* its buddy is found by flipping one bit of its address. */
+/* Bit g of freemap[n] is set when a free block of order n starts at */
+/* granule g. */
+static word freemap[RAM_ORDERS][RAM_GRAINS / 32];
+/* Bit w of freewords[n] is set when word w of freemap[n] isn't 0. */
+static word freewords[RAM_ORDERS];
+/* Bit n is set when there is a free block of order n. */
+static word freeorders;
+
+/* The granule that the address x is in, and the address of granule g. */
+#define grain(x) (((word)(x) - _SRAM) / RAM_GRAIN)
+#define grainaddr(g) (_SRAM + (g)*RAM_GRAIN)
+
+/* Smallest order of block that holds size bytes. */
+static int sizeorder(word size) {
+	if(size <= RAM_GRAIN) {
+		return 0;
+	}
+	return 32 - __builtin_clz((size - 1) / RAM_GRAIN);
+}
+
+static void putfree(word g, int n) {
+	freemap[n][g / 32] |= 1u << (g % 32);
+	freewords[n] |= 1u << (g / 32);
+	freeorders |= 1u << n;
+}
+
+static void takefree(word g, int n) {
+	freemap[n][g / 32] &= ~(1u << (g % 32));
+	if(0 == freemap[n][g / 32]) {
+		freewords[n] &= ~(1u << (g / 32));
+		if(0 == freewords[n]) {
+			freeorders &= ~(1u << n);
 		}
 	}
-	stackusage[i] = 1;
-	return i;
 }
 
-inline void free_stackspace(int i) {
- 	stackusage[i] = 0;
+static int isfree(word g, int n) {
+	return (freemap[n][g / 32] >> (g % 32)) & 0x1;
 }
 
-/* Sets all ram to be unused. */
-void init_ram() {
+/*
+ * Returns the size of the block that get_ram(size) allocates, or 0 if size
+ * is more than all of the ram.
+ */
+word ramsize(word size) {
+	if(size > SRAM_ - _SRAM) {
+		return 0;
+	}
+	return RAM_GRAIN << sizeorder(size);
+}
+
+/*
+ * Allocate a block of at least size bytes. Sizes are rounded up to a power
+ * of two no smaller than RAM_GRAIN, and the block is aligned to its size, so
+ * bigger stacks get several granules that are next to each other. The
+ * smallest free block that fits is found with a few count leading or
+ * trailing zero instructions, without searching. Returns the address of the
+ * block, or 0 if there is no space.
+ */
+word get_ram(word size) {
+	int order, n;
+	word w, g, avail;
+	if(size > SRAM_ - _SRAM) {
+		return 0;
+	}
+	order = n = sizeorder(size);
+	if(0 == (avail = freeorders & (~0u << order))) {
+    printf("No available RAM for %d bytes\n\r", size);
+		return 0;
+	}
+	n = __builtin_ctz(avail);
+	w = __builtin_ctz(freewords[n]);
+	g = 32*w + __builtin_ctz(freemap[n][w]);
+	takefree(g, n);
+/* Split the block in halves until it's the right size, keeping the upper */
+/* halves free. */
+	while(n > order) {
+		n--;
+		putfree(g + (1u << n), n);
+	}
+	return grainaddr(g);
+}
+
+/*
+ * Free the block at addr that was allocated with get_ram(size). It is merged
+ * with its buddy for as long as the buddy is free too.
+ */
+void free_ram(word addr, word size) {
+	int n = sizeorder(size);
+	word g = grain(addr);
+	word buddy;
+	while(n < RAM_ORDERS - 1) {
+		buddy = g ^ (1u << n);
+		if(!isfree(buddy, n)) {
+			break;
+		}
+		takefree(buddy, n);
+		g &= ~(1u << n);
+		n++;
+	}
+	putfree(g, n);
+}
+
+/* Kernel heap pools, one for each size of block. */
+struct kpool kpools[KMALLOC_POOLS];
+/* Shared memory segments, NULL where there is none. Their records are */
+/* allocated from the kernel heap. */
+struct shm *shmtable[NSHM];
+/* Start of the part of the kernel heap that hasn't been given to a pool. */
+static word kbrk;
+
+/* The pool that blocks of size bytes come from. */
+static int kpool(word size) {
+	if(size <= KMALLOC_MIN) {
+		return 0;
+	}
+	return 32 - __builtin_clz(size - 1) - 4;
+}
+
+/*
+ * Allocate a block of at least size bytes, no more than KMALLOC_MAX, from
+ * the kernel heap. A block that was freed is reused first, otherwise a new
+ * one is cut from the heap. Blocks are never given back to the heap, so
+ * each pool only ever grows to the most blocks of its size that have been in
+ * use at once. Takes constant time. Returns NULL if there is no space.
+ */
+void *kmalloc(word size) {
+	struct kpool *pool;
+	void *b;
+	if(0 == size || size > KMALLOC_MAX) {
+		return NULL;
+	}
+	pool = kpools + kpool(size);
+	if(NULL != (b = pool->free)) {
+		pool->free = *(void **)b;
+	}
+	else if(kbrk + pool->size <= (word)&_eheap) {
+		b = (void *)kbrk;
+		kbrk += pool->size;
+	}
+	else {
+		pool->fails++;
+		return NULL;
+	}
+	pool->inuse++;
+	pool->allocs++;
+	return b;
+}
+
+/*
+ * Give the block b of size bytes that came from kmalloc() back to its pool.
+ * Takes constant time.
+ */
+void kfree(void *b, word size) {
+	struct kpool *pool = kpools + kpool(size);
+	*(void **)b = pool->free;
+	pool->free = b;
+	pool->inuse--;
+}
+
+/* Empties the kernel heap. */
+void init_kheap() {
 	int i;
-/* The amount of RAM usage was pushed on the stack during reset. We need to */
-/* round the value up to make sure there's not stack overlap (+ 2). After a */
-/* push, the processor increments the stack pointer to the next word. */
+	kbrk = (word)&_heap;
+	for(i = 0; i < NSHM; i++) {
+		shmtable[i] = NULL;
+	}
+	for(i = 0; i < KMALLOC_POOLS; i++) {
+		kpools[i].free = NULL;
+		kpools[i].size = KMALLOC_MIN << i;
+		kpools[i].inuse = kpools[i].allocs = kpools[i].fails = 0;
+	}
+}
+
+/*
+ * Fill in the kernel and free ram parts of info.
+ */
+void raminfo(struct meminfo *info) {
+	int n, w;
+	info->data = (word)&_edata - (word)&_data;
+	info->bss = (word)&_ebss - (word)&_bss;
+	info->kheap = (word)&_eheap - (word)&_heap;
+	info->kheapused = kbrk - (word)&_heap;
+	info->kstack = (word)&_estack - (word)&_stack;
+	info->kram = (*((word *)(KRAM_USE - 4)) + 1)*RAM_GRAIN;
+	info->ramfree = 0;
+	info->largest = 0;
+	for(n = 0; n < RAM_ORDERS; n++) {
+		for(w = 0; w < RAM_GRAINS / 32; w++) {
+			info->ramfree += __builtin_popcount(freemap[n][w])*(RAM_GRAIN << n);
+		}
+	}
+	if(0 != freeorders) {
+		info->largest = RAM_GRAIN << (31 - __builtin_clz(freeorders));
+	}
+}
+
+/* Frees all the ram after the kernel. */
+void init_ram() {
+	int n;
+	word addr;
+/* The number of granules in use by the kernel was pushed on the stack during */
+/* reset. It's rounded down, so the kernel ends in the next granule (+ 1). */
 /* KRAM_USE is stored one word back (- 4). */
-	for(i = 0; i < *((word *)(KRAM_USE - 4)) + 2; i++) {
-		stackusage[i] = 1;
+	addr = _SRAM + (*((word *)(KRAM_USE - 4)) + 1)*RAM_GRAIN;
+	for(n = 0; n < RAM_ORDERS; n++) {
+		memset(freemap[n], 0, sizeof(freemap[n]));
+		freewords[n] = 0;
+	}
+	freeorders = 0;
+/* Cut the rest of ram into the largest blocks that are aligned. */
+	while(addr < SRAM_) {
+		n = RAM_ORDERS - 1;
+		while(((addr - _SRAM) & ((RAM_GRAIN << n) - 1)) ||
+		      addr + (RAM_GRAIN << n) > SRAM_) {
+			n--;
+		}
+		putfree(grain(addr), n);
+		addr += RAM_GRAIN << n;
+	}
+}
+
+/* 1 if the len bytes at addr are all in the size bytes at start. */
+static int inside(word addr, word len, word start, word size) {
+	return addr >= start && addr - start <= size && len <= size - (addr - start);
+}
+
+/*
+ * Returns 1 if the len bytes at addr are all in ram that p can use, which is
+ * its stack above the guard, its heap regions and its attached shared
+ * memory, or 0 if they aren't. The kernel runs with the default memory map,
+ * so every pointer a process passes in has to be checked before the kernel
+ * uses it, or the process could have the kernel write anywhere.
+ */
+int checkuser(struct pcb *p, word addr, word len) {
+	int i;
+	if(inside(addr, len, p->stack + stackguard(p), \
+	          p->stacksize - stackguard(p))) {
+		return 1;
 	}
-	while(i < SRAM_PAGES) {
-		stackusage[i] = 0;
-		i++;
+	for(i = 0; i < MPU_HEAPREGIONS; i++) {
+		if(0 != p->heap[i] && inside(addr, len, p->heap[i], p->heapsize[i])) {
+			return 1;
+		}
+	}
+	for(i = 0; i < MPU_SHMREGIONS; i++) {
+		if(-1 != p->shm[i] && inside(addr, len, shmtable[p->shm[i]]->addr, \
+		                             shmtable[p->shm[i]]->size)) {
+			return 1;
+		}
 	}
+	return 0;
+}
+
+/*
+ * Returns the RASR value that enables a region of size bytes with the access
+ * permissions and memory type in attr. size must be a power of two of at
+ * least 32 bytes, and the region must start at a multiple of it. Blocks from
+ * get_ram() always do.
+ */
+word mpu_attr(word size, word attr) {
+/* The size field is log2(size) - 1. */
+	return attr | ((30 - __builtin_clz(size)) << 1) | NVIC_MPU_ATTR_ENABLE;
+}
+
+/*
+ * Set up the MPU regions that every process shares and turn the MPU on. The
+ * kernel keeps the default memory map. Processes fault on anything outside
+ * of the shared regions and the regions in their pcb, which scheduler()
+ * loads on every switch.
+ */
+void init_mpu() {
+	NVIC_MPU_BASE_R = mpu_base(_FLASH, MPU_FLASH);
+	NVIC_MPU_ATTR_R = mpu_attr(FLASH_ - _FLASH, MPU_RO | MPU_FLASHMEM);
+	NVIC_MPU_BASE_R = mpu_base(_PERIPH, MPU_PERIPH);
+	NVIC_MPU_ATTR_R = mpu_attr(PERIPH_ - _PERIPH, \
+			NVIC_MPU_ATTR_XN | MPU_RW | MPU_DEVICE | \
+			((~PERIPH_SUBREGIONS & 0xFF) << 8));
+	NVIC_MPU_BASE_R = mpu_base(&_sync, MPU_SYNC);
+	NVIC_MPU_ATTR_R = mpu_attr((word)&_esync - (word)&_sync, \
+			NVIC_MPU_ATTR_XN | MPU_RW | MPU_SRAM);
+	NVIC_MPU_CTRL_R = NVIC_MPU_CTRL_ENABLE | NVIC_MPU_CTRL_PRIVDEFEN;
 }
@@ -9,53 +9,63 @@
 #include <cstring.h>
 #include <tm4c123gh6pm.h>
 #include <hw.h> /* For protect_flash() */
+#include <clock.h> /* For the time slice */
+#include <sync.h> /* For syncpage */
 
 /* From context.s */
-extern void swtch(word);
-extern void initcode(word);
+extern void idle(void);
+/* From vectors.s */
+extern void processor_state(int);
+/* From syscalls.c. Processes that return from their first function exit. */
+extern int exit(int);
 
-/* The largest pid currently RUNNING. Keeping track of this speeds up */
-/* scheduling. */
-int maxpid;
+/* Ready bitmaps, one per priority level. Bit n is set when the process with */
+/* pid n is RUNNABLE or RUNNING at that priority, so picking the next process */
+/* never has to scan ptable. */
+word readyq[NPRIO];
+/* Bit n is set when readyq[n] is not empty. */
+word prioritymap;
 /* Array of processes for the scheduler. */
 struct pcb ptable[MAX_PROC];
 /* Pid of the current process. */
 int currpid;
+/* Pid of a process the current one handed the cpu to, or NULLPID. */
+static int handoffpid;
+#ifdef SWTCH_STATS
+/* Cycle count at the start of the last context switch, and how many cycles */
+/* it took. Written by swtch(). */
+word swtchstart;
+word swtchcycles;
+#endif
 
 /*
- * Initializes the first user process and runs it.
- * @param name
- * 	The name of the new process
+ * Initializes the first user process and runs it. Does not return unless the
+ * first process can't be created.
  */
 void user_init() {
-/* See mem.h for an explanation of this calculation. */
-  if(MAX_PROC > SRAM_PAGES - (*((word *)(KRAM_USE - 4)) + 2)) {
-    printf("MAX_PROC is set to allow more processes than the available RAM "\
-        "can hold. Please use a value no greater than %d\n\r", \
-       SRAM_PAGES - (*((word *)(KRAM_USE - 4)) + 2));
-    return;
-  }
-/* Set all globals. Compiler doesn't seem to want to cooperate with global */
-/* initializations of variables. */
-	maxpid = 0;
-	currpid = 0;
-	struct pcb *initshell = reserveproc("initshell");
+	struct pcb *initshell = reserveproc("initshell", STACK_SIZE);
 	if(NULL == initshell) {
 		return;
 	}
-	initshell->context.pc = (word)smain;
-	scheduler();
+	initcontext(initshell, (word)smain, 0);
+	enqueue(initshell);
+/* swtch() runs as soon as interrupts are enabled and never comes back here */
+/* since there is no running process to save. */
+	NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
+	processor_state(1);
+	while(1);
 }
 
 /*
- * Reserve a process for further initialization and scheduling. Returns the
- * pcb of the reserved process.
+ * Reserve a process for further initialization and scheduling, with at least
+ * stacksize bytes of stack above its guard. The stack is the smallest block
+ * from get_ram() whose upper 7/8 fit stacksize, and the process gets all of
+ * that, so sizes of 7/8 of a power of two waste nothing. Returns the pcb of
+ * the reserved process, or NULL if there is no room for it.
  */
-struct pcb* reserveproc(char *name) {
-	int rampg;
-	int i = 0;
-/* Back up the value of maxpid incase this fails. */
-  int maxpid_bu = maxpid;
+struct pcb* reserveproc(char *name, word stacksize) {
+	word stack, size;
+	int i = 0, j;
 
 	if(sizeof(name) > 16 && NULL != name) {
     printf("Buffer overrun for process name\n\r");
@@ -63,33 +73,55 @@ struct pcb* reserveproc(char *name) {
 	}
 /* Find an UNUSED process from the process table. */
 	while(1) {
-		if(ptable[i].state == UNUSED) {
-			if(maxpid < i) {
-				maxpid = i;
-			}
-			break;
-		}
-		else if(i > MAX_PROC) {
-      maxpid = maxpid_bu;
+		if(i >= MAX_PROC) {
       printf("No unused proc's in ptable\n\r");
 			return NULL;
 		}
+		else if(ptable[i].state == UNUSED) {
+			break;
+		}
 		else {
 			i++;
 		}
 	}
-/* Top of stack for this process. */
-	if(-1 != (rampg = get_stackspace())) {
-		ptable[i].rampg = rampg;
-		ptable[i].context.sp = stacktop(rampg);
+	if(stacksize > SRAM_ - _SRAM) {
+		return NULL;
+	}
+	if(stacksize < STACK_MIN) {
+		stacksize = STACK_MIN;
+	}
+/* The guard is the lowest eighth of the block, so it adds a seventh of what */
+/* was asked for. */
+	size = ramsize(stacksize + (stacksize + 6) / 7);
+	if(0 != (stack = get_ram(size))) {
+		ptable[i].stack = stack;
 	}
 	else {
-    free_stackspace(rampg);
-    ptable[i].context.sp = 0;
-    maxpid = maxpid_bu;
 		return NULL;
 	}
+	ptable[i].stacksize = size;
+	paintstack(ptable + i);
+	ptable[i].mpu[0] = mpu_base(stack, MPU_STACK);
+/* The lowest subregion is left out as a guard. */
+	ptable[i].mpu[1] = mpu_attr(ptable[i].stacksize, \
+			NVIC_MPU_ATTR_XN | MPU_RW | MPU_SRAM | (0x1 << 8));
+/* No heap or shared memory until the process asks for them. */
+	for(j = 0; j < MPU_HEAPREGIONS; j++) {
+		ptable[i].heap[j] = 0;
+	}
+	for(j = 0; j < MPU_SHMREGIONS; j++) {
+		ptable[i].shm[j] = -1;
+	}
+	for(j = 0; j < NFD; j++) {
+		ptable[i].ofile[j] = NULL;
+	}
+	for(j = 1; j < MPU_PROCREGIONS; j++) {
+		setregion(ptable + i, j, 0, 0);
+	}
 	ptable[i].state = RESERVED;
+	ptable[i].priority = ptable[i].basepriority = PRIO_DEFAULT;
+	ptable[i].lockwait = -1;
+	ptable[i].notified = 0;
 	strncpy(ptable[i].name, name, strlen(name));
 /* The pid is always the index where it was secured from. */
 	ptable[i].pid = i;
@@ -97,35 +129,133 @@ struct pcb* reserveproc(char *name) {
 }
 
 /*
- * Initialize a RESERVED process so it's ready to be context switched too.
- * This function alters context, so must it be run just before the context
- * switcher.
+ * Fill the stack of p with STACK_CANARY, so that stackpeak() can tell how
+ * much of it has been used.
  */
-static void initproc(struct pcb *reserved) {
-	reserved->state = EMBRYO;
-  reserved->context.r7 = reserved->context.sp;
-/* Leave room for the stack frame to pop into when swtch()'ed to. initcode */
-/* will put the the sp at the top of the stack, then swtch() will put the sp */
-/* into lr. */
-	reserved->context.sp = reserved->context.sp - (CTXSTACK);
-/* Pointer to proc is cast to a word because the compiler didn't seem to */
-/* want to give me the pointer. It always came out to the value of sp in */
-/* context struct. */
-	initcode((word)reserved);
-	reserved->state = RUNNABLE;
+void paintstack(struct pcb *p) {
+	word *w = (word *)p->stack;
+	word *end = (word *)(p->stack + p->stacksize);
+	while(w < end) {
+		*w++ = STACK_CANARY;
+	}
+}
+
+/*
+ * Returns the most bytes of its stack that p has ever used, not counting the
+ * guard. Stacks grow down, so the canaries that are left are all at the
+ * bottom.
+ */
+word stackpeak(struct pcb *p) {
+	word *w = (word *)(p->stack + stackguard(p));
+	word *end = (word *)(p->stack + p->stacksize);
+	while(w < end && STACK_CANARY == *w) {
+		w++;
+	}
+	return (word)end - (word)w;
+}
+
+/*
+ * Build the stack of a RESERVED process so that swtch() starts it at pc with
+ * arg in r0, as if it had been interrupted right before the first
+ * instruction. If the function at pc returns, the process exits with the
+ * returned value.
+ */
+void initcontext(struct pcb *reserved, word pc, word arg) {
+/* The processor expects exception frames to be 8 byte aligned. */
+	struct trapframe *tf = (struct trapframe *)(stacktop(reserved) & ~0x7);
+	tf--;
+	memset(tf, 0, sizeof(struct trapframe));
+	tf->r0 = arg;
+	tf->lr = (word)exit;
+/* Exception return takes the pc without the thumb bit that */
+/* function pointers have set. */
+	tf->pc = pc & ~0x1;
+	tf->xpsr = XPSR_THUMB;
+	reserved->context = (struct context *)tf - 1;
+	memset(reserved->context, 0, sizeof(struct context));
+	reserved->context->lr = EXC_RETURN_PSP;
+}
+
+/*
+ * Return the registers that were stacked by the processor when the process
+ * last entered the kernel. The process must not be RUNNING.
+ */
+struct trapframe *trapframe(struct pcb *p) {
+	word *tf = (word *)(p->context + 1);
+/* s16-s31 are saved between the context and the trapframe when the process */
+/* was using the fpu. */
+	if(!(p->context->lr & EXC_RETURN_NOFPU)) {
+		tf += 16;
+	}
+	return (struct trapframe *)tf;
 }
 
 /* Set all unused procs to unused state and initialize pcb members to known */
 /* values. */
 void init_ptable() {
+/* Set all globals. Compiler doesn't seem to want to cooperate with global */
+/* initializations of variables. */
+	for(int i = 0; i < NPRIO; i++) {
+		readyq[i] = 0;
+	}
+	prioritymap = 0;
+	currpid = 0;
+	handoffpid = NULLPID;
 	for(int i = 0; i < MAX_PROC; i++) {
 		ptable[i].state = UNUSED;
 		ptable[i].numchildren = 0;
     ptable[i].waitpid = NULLPID;
 		ptable[i].ppid = NULLPID;
     ptable[i].pid = NULLPID;
-		ptable[i].initflag = 1;
-		ptable[i].context.sp = ptable[i].context.pc = 0;
+		ptable[i].priority = ptable[i].basepriority = PRIO_DEFAULT;
+		ptable[i].lockwait = -1;
+		ptable[i].notified = 0;
+		ptable[i].timed = 0;
+		ptable[i].tnext = ptable[i].tprev = NULL;
+		ptable[i].waitq = NULL;
+		ptable[i].qnext = ptable[i].qprev = NULL;
+		ptable[i].waiters.head = NULL;
+		ptable[i].senders.head = NULL;
+		ptable[i].waitstatus = NULL;
+		ptable[i].child = ptable[i].sibling = NULL;
+		ptable[i].context = NULL;
+		ptable[i].hasretval = 0;
+	}
+}
+
+/*
+ * Return a process to the UNUSED state so that its pcb can be reserved
+ * again. Its stack must already have been freed.
+ */
+void freeproc(struct pcb *p) {
+	p->state = UNUSED;
+	p->numchildren = 0;
+	p->waitpid = NULLPID;
+	p->ppid = NULLPID;
+	p->pid = NULLPID;
+	p->waitstatus = NULL;
+	p->child = p->sibling = NULL;
+	p->context = NULL;
+	p->hasretval = 0;
+	strncpy(p->name, "\0", 1);
+}
+
+/*
+ * Give p read and write access to the size bytes of ram at addr with its
+ * region'th MPU region, or take the region away if size is 0. addr must be a
+ * block from get_ram(). The region is loaded right away if p is running,
+ * since scheduler() only loads them on a switch.
+ */
+void setregion(struct pcb *p, int region, word addr, word size) {
+	p->mpu[2*region] = mpu_base(addr, MPU_STACK + region);
+	p->mpu[2*region + 1] = 0;
+	if(0 != size) {
+		p->mpu[2*region + 1] = mpu_attr(size, \
+				NVIC_MPU_ATTR_XN | MPU_RW | MPU_SRAM);
+	}
+	if(p->pid == currpid) {
+		NVIC_MPU_BASE_R = p->mpu[2*region];
+		NVIC_MPU_ATTR_R = p->mpu[2*region + 1];
 	}
 }
 
@@ -135,53 +265,311 @@ struct pcb* currproc() {
 }
 
 /*
- * Return the process belonging to pid, or NULL if it couldn't be found.
+ * Return the process belonging to pid, or NULL if it couldn't be found. The
+ * pid is always the index of the process in ptable.
  */
 struct pcb* pidproc(int pid) {
-	int i;
-	for(i = 0; i < MAX_PROC; i++) {
-		if(pid == ptable[i].pid) {
-			return (ptable + i);
+	if(pid < 0 || pid >= MAX_PROC || pid != ptable[pid].pid) {
+		return NULL;
+	}
+	return (ptable + pid);
+}
+
+/*
+ * Mark a process as ready to run at its priority. Must be called whenever a
+ * process becomes RUNNABLE so that the scheduler can find it.
+ */
+void enqueue(struct pcb *p) {
+	readyq[p->priority] |= (1u << p->pid);
+	prioritymap |= (1u << p->priority);
+}
+
+/*
+ * Remove a process from the ready bitmaps. Must be called whenever a process
+ * stops being RUNNABLE (waiting or exiting).
+ */
+void dequeue(struct pcb *p) {
+	readyq[p->priority] &= ~(1u << p->pid);
+	if(0 == readyq[p->priority]) {
+		prioritymap &= ~(1u << p->priority);
+	}
+}
+
+/*
+ * Put p in q behind the processes that have the same or a higher priority.
+ */
+static void waitq_insert(struct waitq *q, struct pcb *p) {
+	struct pcb *prev = NULL;
+	struct pcb *next = q->head;
+	while(NULL != next && next->priority >= p->priority) {
+		prev = next;
+		next = next->qnext;
+	}
+	p->qprev = prev;
+	p->qnext = next;
+	if(NULL != prev) {
+		prev->qnext = p;
+	}
+	else {
+		q->head = p;
+	}
+	if(NULL != next) {
+		next->qprev = p;
+	}
+	p->waitq = q;
+}
+
+/*
+ * Take p out of the wait queue it is in.
+ */
+static void waitq_remove(struct pcb *p) {
+	if(NULL != p->qprev) {
+		p->qprev->qnext = p->qnext;
+	}
+	else {
+		p->waitq->head = p->qnext;
+	}
+	if(NULL != p->qnext) {
+		p->qnext->qprev = p->qprev;
+	}
+	p->qnext = p->qprev = NULL;
+	p->waitq = NULL;
+}
+
+/*
+ * Change the priority of a process, moving it to the new level's run queue
+ * if it is ready, or to its new place in the wait queue it is blocked on.
+ */
+void changepriority(struct pcb *p, int priority) {
+	struct waitq *q = p->waitq;
+	if(readyq[p->priority] & (1u << p->pid)) {
+		dequeue(p);
+		p->priority = priority;
+		enqueue(p);
+	}
+	else if(NULL != q) {
+		waitq_remove(p);
+		p->priority = priority;
+		waitq_insert(q, p);
+	}
+	else {
+		p->priority = priority;
+	}
+}
+
+/*
+ * Block the running process on q in the given state until it is woken up by
+ * wakeproc() or wakeone(). It is kept behind the processes in q that have the
+ * same or a higher priority. The switch happens when the kernel is done.
+ */
+void sleepon(struct waitq *q, enum procstate state) {
+	struct pcb *p = currproc();
+	dequeue(p);
+	p->state = state;
+	waitq_insert(q, p);
+}
+
+/*
+ * Like sleepon(), but the process is also woken up after ms milliseconds
+ * unless ms is WAIT_FOREVER. A process that times out returns TIMEDOUT from
+ * its system call.
+ */
+void sleepfor(struct waitq *q, enum procstate state, word ms) {
+	sleepon(q, state);
+	if(WAIT_FOREVER != ms) {
+/* The current tick is already partly over, so wait one more. */
+		timer_add(currproc(), mstoticks(ms) + 1);
+	}
+}
+
+/*
+ * Set what the system call that p is blocked in returns. It can't be written
+ * to p's trapframe yet, since p may not have been switched out, so
+ * scheduler() writes it when p runs next.
+ */
+void setreturn(struct pcb *p, word val) {
+	p->retval = val;
+	p->hasretval = 1;
+}
+
+/*
+ * Run p next instead of waiting for its turn, if it has the same priority as
+ * the highest priority ready process. The current process gives up the rest
+ * of its time slice to it. Used when the current process just woke p up to
+ * handle something it is waiting on.
+ */
+void handoff(struct pcb *p) {
+	handoffpid = p->pid;
+	slice = 0;
+}
+
+/*
+ * Take a blocked process out of the wait queue and the timer wheel if it is
+ * in them, without making it ready. Takes constant time.
+ */
+void unblock(struct pcb *p) {
+	if(p->timed) {
+		timer_del(p);
+	}
+	if(NULL != p->waitq) {
+		waitq_remove(p);
+	}
+}
+
+/*
+ * Make a blocked process ready again, taking it out of the wait queue and
+ * the timer wheel if it is in them. Takes constant time.
+ */
+void wakeproc(struct pcb *p) {
+	unblock(p);
+	p->state = RUNNABLE;
+	enqueue(p);
+}
+
+/*
+ * Wake up the first process in q. Returns the process that was woken up, or
+ * NULL if q was empty.
+ */
+struct pcb *wakeone(struct waitq *q) {
+	struct pcb *p = q->head;
+	if(NULL != p) {
+		wakeproc(p);
+	}
+	return p;
+}
+
+/*
+ * Return the ready bitmap of the highest priority level that has a ready
+ * process, or 0 if nothing is ready. clz is a single instruction on the
+ * cortex-m4 so this takes the same time no matter how many processes there
+ * are.
+ */
+static word topready() {
+	if(0 == prioritymap) {
+		return 0;
+	}
+	return readyq[31 - __builtin_clz(prioritymap)];
+}
+
+/*
+ * Return the pid of the next process to run, or -1 if nothing is ready. The
+ * highest priority level with a ready process is always chosen. Within that
+ * level, the first ready process after pid is chosen, wrapping around to the
+ * lowest pid, so processes of equal priority take turns. Counting trailing
+ * zeros compiles to rbit and clz.
+ */
+static int nextready(int pid) {
+	word level, above;
+	if(0 == (level = topready())) {
+		return -1;
+	}
+/* Only look at bits above pid. 2 << 31 is 0, which leaves no bits. */
+	above = level & ~((2u << pid) - 1);
+	if(0 == above) {
+		above = level;
+	}
+	return __builtin_ctz(above);
+}
+
+/*
+ * Returns 1 if the running process has to give up the cpu when its time
+ * slice is used up, or 0 if nothing else is waiting to run.
+ */
+int timesliced() {
+	return 0 != (topready() & ~(1u << currpid));
+}
+
+/*
+ * Switch to another process as soon as the kernel is done, if the running
+ * process can't run anymore, a higher priority process is ready, or the time
+ * slice of the running process is up and another process of the same
+ * priority is waiting.
+ */
+void preempt() {
+	word top = topready();
+	if(!(top & (1u << currpid))) {
+		NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
+	}
+	else if(slice <= 0) {
+		if(top & ~(1u << currpid)) {
+			NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
+		}
+/* Nobody is waiting for a turn, so start a new slice. */
+		else {
+			slice = TIMESLICE;
 		}
 	}
-	return NULL;
 }
 
 /*
- * Round Robin scheduler. Triggered by tick interrupt every 1ms
+ * Act on changes an exception handler made to the ready and sleeping
+ * processes. Switches away from the running process if preempt() says so,
+ * and in a tickless kernel programs the systick for the next deadline, which
+ * may now be a woken process's turn. Must be the last thing done by a
+ * handler that woke a process up, including interrupt handlers of drivers.
+ */
+void reschedule() {
+	preempt();
+#ifdef TICKLESS
+	clock_arm();
+#endif
+}
+
+/*
+ * Fixed priority, round robin scheduler. Called from swtch() with interrupts
+ * disabled, and sp pointing at the context that was saved for the process
+ * that was running, or 0 if there was nothing to save. Returns the saved
+ * context of the process to run next. If nothing is ready, the cpu sleeps
+ * until an interrupt makes something ready.
  */
-void scheduler() {
-/* Current index of the scheduler. */
-	static int index;
-/* For initialization. arm-none-eabi-gcc initialises to -1 */
-	if(index < 0) {
-		index = 0;
+word scheduler(word sp) {
+	int pid, i;
+	struct pcb *p = currproc();
+	if(0 != sp && UNUSED != p->state && ZOMBIE != p->state) {
+		p->context = (struct context *)sp;
+	}
+	if(RUNNING == p->state) {
+		p->state = RUNNABLE;
 	}
 	while(1) {
-/* Reset if we're looking passed the largest pid, there will be no RUNNABLE */
-/* processes passed that index. */
-		if(index > maxpid || index > MAX_PROC) {
-			index = 0;
-		}
-		struct pcb *schedproc = &ptable[index];
-/* If the process is waiting for another, check to see if it's exited. */
-		if(schedproc->state == WAITING && \
-			ptable[schedproc->waitpid].state == UNUSED) {
-			schedproc->state = RUNNABLE;
-			schedproc->waitpid = NULLPID;
+/* A process that was handed the cpu goes first, unless something of higher */
+/* priority is ready. */
+		if(NULLPID != handoffpid && (topready() & (1u << handoffpid))) {
+			pid = handoffpid;
+			slice = TIMESLICE;
+			break;
 		}
-		if(schedproc->state == RESERVED || schedproc->state == RUNNABLE) {
-			currpid = schedproc->pid;
-			if(1 == schedproc->initflag) {
-				initproc(ptable + index);
-				schedproc->initflag = 0;
-			}
-			index++;
-			schedproc->state = RUNNING;
-			swtch(schedproc->context.sp);
+/* Let the running process use up its time slice unless something of higher */
+/* priority is ready, or it can't run anymore. */
+		else if(slice > 0 && (topready() & (1u << currpid))) {
+			pid = currpid;
+			break;
 		}
-		else {
-			index++;
+/* Start looking after the process that just ran so that everyone gets a */
+/* turn. */
+		else if(-1 != (pid = nextready(currpid))) {
+			slice = TIMESLICE;
+			break;
 		}
+		idle();
+	}
+	currpid = pid;
+	syncpage->pid = pid;
+	handoffpid = NULLPID;
+	p = ptable + pid;
+	p->state = RUNNING;
+	if(p->hasretval) {
+		trapframe(p)->r0 = p->retval;
+		p->hasretval = 0;
 	}
-}	
+/* Give the process its own MPU regions. The exception return is a barrier, */
+/* so they are in effect by the time it runs. */
+	for(i = 0; i < MPU_PROCREGIONS; i++) {
+		NVIC_MPU_BASE_R = p->mpu[2*i];
+		NVIC_MPU_ATTR_R = p->mpu[2*i + 1];
+	}
+#ifdef TICKLESS
+	clock_arm();
+#endif
+	return (word)p->context;
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : ring.c                                                          *
+ * Synopsis : Lock free single producer, single consumer ring of words. Used  *
+ *            by the kernel and by processes.                                 *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <types.h>
+#include <ring.h>
+
+/* From context.s */
+extern void barrier(void);
+
+/*
+ * Make an empty ring at r that holds size items. size must be a power of 2,
+ * and r must have RING_BYTES(size) bytes.
+ */
+void ring_init(struct ring *r, word size) {
+	r->head = 0;
+	r->tail = 0;
+	r->size = size;
+}
+
+/*
+ * Put item at the end of the ring. Only the producer may call this. Returns
+ * the number of items in the ring, so 1 means the consumer may be waiting
+ * for it, or -1 if the ring is full.
+ */
+int ring_put(struct ring *r, word item) {
+	word head = r->head;
+	if(head - r->tail == r->size) {
+		return -1;
+	}
+	r->buf[head & (r->size - 1)] = item;
+/* The item has to be in the ring before the consumer can see it. */
+	barrier();
+	r->head = head + 1;
+	return head + 1 - r->tail;
+}
+
+/*
+ * Take the item at the front of the ring. Only the consumer may call this.
+ * Returns 0 on success, or -1 if the ring is empty.
+ */
+int ring_get(struct ring *r, word *item) {
+	word tail = r->tail;
+	if(r->head == tail) {
+		return -1;
+	}
+/* Don't read the item before seeing the head that covers it. */
+	barrier();
+	*item = r->buf[tail & (r->size - 1)];
+/* The item has to be read before the producer can reuse its slot. */
+	barrier();
+	r->tail = tail + 1;
+	return 0;
+}
+
+/*
+ * Returns the number of items in the ring.
+ */
+word ring_count(struct ring *r) {
+	return r->head - r->tail;
+}
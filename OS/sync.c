@@ -0,0 +1,304 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : sync.c                                                          *
+ * Synopsis : Semaphores and mutexes. The uncontended paths are in            *
+ *            syscalls.c and never enter the kernel.                          *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <types.h>
+#include <proc.h>
+#include <sync.h>
+
+/* Processes blocked on each semaphore and mutex. */
+static struct waitq semwaiters[NSEM];
+static struct waitq mutexwaiters[NMUTEX];
+/* 1 for the semaphores and mutexes that have been created. */
+static int semused[NSEM];
+static int mutexused[NMUTEX];
+/* Processes blocked in sysfutexwait(). ipcbuf is the address they wait on. */
+static struct waitq futexq[NFUTEXQ];
+
+/* Wait queue for the futex at addr. */
+#define futexq(addr) (&futexq[((word)(addr) >> 2) % NFUTEXQ])
+
+/*
+ * Initialize the semaphores and mutexes.
+ */
+void init_sync() {
+	int i;
+	syncpage->pid = INITPID;
+	for(i = 0; i < NSEM; i++) {
+		semwaiters[i].head = NULL;
+		semused[i] = 0;
+		syncpage->sem[i] = 0;
+	}
+	for(i = 0; i < NMUTEX; i++) {
+		mutexwaiters[i].head = NULL;
+		mutexused[i] = 0;
+		syncpage->mutex[i] = 0;
+	}
+	for(i = 0; i < NFUTEXQ; i++) {
+		futexq[i].head = NULL;
+	}
+}
+
+/*
+ * Create a semaphore with count units. Returns its id, or -1 if there are
+ * no free semaphores.
+ */
+int syssemcreate(word count) {
+	int i;
+	if(count >= SEM_WAITERS) {
+		return -1;
+	}
+	for(i = 0; i < NSEM; i++) {
+		if(!semused[i]) {
+			semused[i] = 1;
+			syncpage->sem[i] = count;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Destroy the semaphore id. Returns 0 on success, or -1 if there is no such
+ * semaphore or processes are blocked on it.
+ */
+int syssemdestroy(int id) {
+	if(id < 0 || id >= NSEM || !semused[id] || NULL != semwaiters[id].head) {
+		return -1;
+	}
+	semused[id] = 0;
+	return 0;
+}
+
+/*
+ * Take a unit from the semaphore id, blocking until there is one. Returns 0,
+ * or -1 if there is no such semaphore.
+ */
+int syssemwait(int id) {
+	if(id < 0 || id >= NSEM || !semused[id]) {
+		return -1;
+	}
+	if(0 != (syncpage->sem[id] & ~SEM_WAITERS)) {
+		syncpage->sem[id]--;
+		return 0;
+	}
+/* syssempost() hands the unit straight to us. */
+	syncpage->sem[id] = SEM_WAITERS;
+	sleepon(&semwaiters[id], BLOCKED);
+	return 0;
+}
+
+/*
+ * Give a unit to the semaphore id, or to the highest priority process that
+ * is blocked on it. Returns 0 on success, or -1 if there is no such
+ * semaphore or its count would overflow.
+ */
+int syssempost(int id) {
+	if(id < 0 || id >= NSEM || !semused[id]) {
+		return -1;
+	}
+	if(NULL != wakeone(&semwaiters[id])) {
+		if(NULL == semwaiters[id].head) {
+			syncpage->sem[id] = 0;
+		}
+		return 0;
+	}
+	if(SEM_WAITERS - 1 <= (syncpage->sem[id] & ~SEM_WAITERS)) {
+		return -1;
+	}
+	syncpage->sem[id] = (syncpage->sem[id] & ~SEM_WAITERS) + 1;
+	return 0;
+}
+
+/*
+ * Create an unlocked mutex. Returns its id, or -1 if there are no free
+ * mutexes.
+ */
+int sysmutexcreate() {
+	int i;
+	for(i = 0; i < NMUTEX; i++) {
+		if(!mutexused[i]) {
+			mutexused[i] = 1;
+			syncpage->mutex[i] = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Destroy the mutex id. Returns 0 on success, or -1 if there is no such
+ * mutex or it is locked.
+ */
+int sysmutexdestroy(int id) {
+	if(id < 0 || id >= NMUTEX || !mutexused[id] || 0 != syncpage->mutex[id]) {
+		return -1;
+	}
+	mutexused[id] = 0;
+	return 0;
+}
+
+/*
+ * Returns the owner of the mutex id, or NULL if it is unlocked. The mutex
+ * word is in the sync page, which every process can write, so the owner it
+ * names is only believed if it is a live process that isn't itself blocked
+ * on the mutex. Otherwise the mutex is treated as unlocked, so a forged
+ * owner can't be given another process's priority or keep it waiting.
+ */
+static struct pcb *mutexowner(int id) {
+	word owner = syncpage->mutex[id] & ~MUTEX_WAITERS;
+	struct pcb *p;
+	if(0 == owner || owner > MAX_PROC || NULL == (p = pidproc(owner - 1))) {
+		return NULL;
+	}
+	if(UNUSED == p->state || RESERVED == p->state || EMBRYO == p->state ||
+	   ZOMBIE == p->state || id == p->lockwait) {
+		return NULL;
+	}
+	return p;
+}
+
+/*
+ * Raise the priority of owner to priority, and of the owner of the mutex
+ * owner is blocked on, and so on down the chain, so that a lower priority
+ * process can't keep a higher priority one waiting behind a third process
+ * of middling priority.
+ */
+static void inherit(struct pcb *owner, int priority) {
+	while(NULL != owner && owner->priority < priority) {
+		changepriority(owner, priority);
+		if(-1 == owner->lockwait) {
+			break;
+		}
+		owner = mutexowner(owner->lockwait);
+	}
+}
+
+/*
+ * Returns the priority p should run at. That is its own priority, or the
+ * priority of the highest priority process blocked on a mutex p owns if
+ * that is higher.
+ */
+int lockpriority(struct pcb *p) {
+	int priority = p->basepriority;
+	int i;
+	for(i = 0; i < NMUTEX; i++) {
+		if(mutexused[i] && NULL != mutexwaiters[i].head && p == mutexowner(i) &&
+		   mutexwaiters[i].head->priority > priority) {
+			priority = mutexwaiters[i].head->priority;
+		}
+	}
+	return priority;
+}
+
+/*
+ * Lock the mutex id, blocking until its owner unlocks it. The owner runs at
+ * the priority of the caller in the meantime if that is higher than its
+ * own. Returns 0 on success, or -1 if there is no such mutex or the caller
+ * already owns it.
+ */
+int sysmutexlock(int id) {
+	struct pcb *p = currproc();
+	struct pcb *owner;
+	if(id < 0 || id >= NMUTEX || !mutexused[id]) {
+		return -1;
+	}
+	owner = mutexowner(id);
+	if(p == owner) {
+		return -1;
+	}
+/* Unlocked since the caller looked, or the owner is gone. */
+	if(NULL == owner) {
+		syncpage->mutex[id] = (syncpage->mutex[id] & MUTEX_WAITERS) | (p->pid + 1);
+		return 0;
+	}
+/* sysmutexunlock() hands the mutex straight to us. */
+	syncpage->mutex[id] |= MUTEX_WAITERS;
+	p->lockwait = id;
+	sleepon(&mutexwaiters[id], BLOCKED);
+	inherit(owner, p->priority);
+	return 0;
+}
+
+/*
+ * Give the mutex id to the highest priority process blocked on it, or
+ * unlock it if there is none.
+ */
+static void release(int id) {
+	struct pcb *next = wakeone(&mutexwaiters[id]);
+	if(NULL == next) {
+		syncpage->mutex[id] = 0;
+		return;
+	}
+	next->lockwait = -1;
+	syncpage->mutex[id] = next->pid + 1;
+	if(NULL != mutexwaiters[id].head) {
+		syncpage->mutex[id] |= MUTEX_WAITERS;
+	}
+}
+
+/*
+ * Unlock the mutex id, which the caller owns. The caller goes back to the
+ * priority it had before anything blocked on the mutex. Returns 0 on
+ * success, or -1 if there is no such mutex or the caller doesn't own it.
+ */
+int sysmutexunlock(int id) {
+	struct pcb *p = currproc();
+	if(id < 0 || id >= NMUTEX || !mutexused[id] || p != mutexowner(id)) {
+		return -1;
+	}
+	release(id);
+	changepriority(p, lockpriority(p));
+	return 0;
+}
+
+/*
+ * Unlock the mutexes owned by p, since it is exiting.
+ */
+void sync_exit(struct pcb *p) {
+	int i;
+	for(i = 0; i < NMUTEX; i++) {
+		if(mutexused[i] && p == mutexowner(i)) {
+			release(i);
+		}
+	}
+}
+
+/*
+ * Block until sysfutexwake() is called for addr, if addr still holds
+ * expected. Checking and blocking can't be interrupted by another process,
+ * so a wake up that comes after the caller saw the value it is waiting on
+ * change is never lost. Returns 0 when woken up, or -1 if addr didn't hold
+ * expected, isn't word aligned or isn't in the caller's memory.
+ */
+int sysfutexwait(volatile word *addr, word expected) {
+	if(0 != ((word)addr & 3) ||
+	   !checkuser(currproc(), (word)addr, sizeof(word)) || expected != *addr) {
+		return -1;
+	}
+	currproc()->ipcbuf = (word)addr;
+	sleepon(futexq(addr), BLOCKED);
+	return 0;
+}
+
+/*
+ * Wake up to n of the processes waiting on addr, highest priority first.
+ * Returns the number that were woken up.
+ */
+int sysfutexwake(volatile word *addr, int n) {
+	struct pcb *p = futexq(addr)->head;
+	struct pcb *next;
+	int woken = 0;
+	while(NULL != p && woken < n) {
+		next = p->qnext;
+		if((word)addr == p->ipcbuf) {
+			wakeproc(p);
+			woken++;
+		}
+		p = next;
+	}
+	return woken;
+}
@@ -5,43 +5,472 @@
  * Date     : July 18th, 2019                                                 *
  *****************************************************************************/
 #include <types.h>
-#include <proc.h>
 #include <syscalls.h> //Some functions have attributes
+#include <mem.h> /* For struct meminfo */
+#include <sync.h> /* For the semaphore and mutex words */
 /* Syscall numbers */
 #define FORK 0
 #define WAIT 1
 #define EXIT 2
 #define FLASH 3
+#define SETPRIORITY 4
+#define GETPRIORITY 5
+#define SLEEP 6
+#define YIELD 7
+#define SPAWN 8
+#define CYCLES 9
+#define STACKUSE 10
+#define SBRK 11
+#define SHMCREATE 12
+#define SHMATTACH 13
+#define SHMDETACH 14
+#define MEMINFO 15
+#define MQCREATE 16
+#define MQDESTROY 17
+#define MQSEND 18
+#define MQRECV 19
+#define SEND 20
+#define RECEIVE 21
+#define REPLY 22
+#define RINGWAIT 23
+#define RINGWAKE 24
+#define SEMCREATE 25
+#define SEMDESTROY 26
+#define SEMWAIT 27
+#define SEMPOST 28
+#define MUTEXCREATE 29
+#define MUTEXDESTROY 30
+#define MUTEXLOCK 31
+#define MUTEXUNLOCK 32
+#define FUTEXWAIT 33
+#define FUTEXWAKE 34
+#define NOTIFY 35
+#define WAITBITS 36
+#define PIPE 37
+#define READ 38
+#define WRITE 39
+#define CLOSE 40
 
-/* From syscall.s */
-extern int syscall(int sysnum, struct pcb *);
-extern int syscall1(int sysnum, struct pcb *, void *arg1);
-extern int syscall2(int sysnum, struct pcb *, void *arg1, void *arg2);
-extern int syscall3(int sysnum, struct pcb *, void *arg1, void *arg2, void *arg3);
+/* From syscallsasm.s */
+extern int syscall(int sysnum, word arg1, word arg2, word arg3);
 
 int flash(void *saddr, void *eaddr, void *faddr) {
-  return syscall3(FLASH, currproc(), saddr, eaddr, faddr);
+  return syscall(FLASH, (word)saddr, (word)eaddr, (word)faddr);
 }
 
 int fork() {
-	return syscall(FORK, currproc());
+	return syscall(FORK, 0, 0, 0);
 }
 
+/*
+ * Wait for the child belonging to pid to exit, or for any child if pid is
+ * ANYPID, and reap it. The exit code of the child is put in status unless
+ * status is NULL. Returns the pid of the reaped child, or -1 if there is no
+ * such child.
+ */
+int waitpid(int pid, int *status) {
+	return syscall(WAIT, pid, (word)status, 0);
+}
+
+/*
+ * Wait for the child belonging to pid to exit, ignoring its exit code.
+ */
 int wait(int pid) {
-	int ret;
-	struct pcb *waitproc = currproc();
-	ret = syscall1(WAIT, waitproc, &pid);
-/* Wait for state to change. This is done here because privledged code */
-/* disables interrupts, so the tick interrupt gets masked out. Interrupts are */
-/* allowed here. */
-	while(WAITING == waitproc->state);
-	return ret;
+	return waitpid(pid, NULL);
+}
+
+/*
+ * Set the scheduling priority of pid, which is the caller or one of its
+ * children, to no more than the caller's own. Higher priorities always run
+ * first. Returns 0 on success, -1 on failure.
+ */
+int setpriority(int pid, int priority) {
+	return syscall(SETPRIORITY, pid, priority, 0);
+}
+
+/*
+ * Returns the scheduling priority of pid, or -1 on failure.
+ */
+int getpriority(int pid) {
+	return syscall(GETPRIORITY, pid, 0, 0);
+}
+
+/*
+ * Sleep for at least ms milliseconds without using the cpu. Returns 0.
+ */
+int sleep_ms(word ms) {
+	return syscall(SLEEP, ms, 0, 0);
+}
+
+/*
+ * Give up the rest of the time slice to the next ready process of the same
+ * priority. Returns right away if there isn't one.
+ */
+int yield() {
+	return syscall(YIELD, 0, 0, 0);
+}
+
+/*
+ * Start a new process that runs fn(arg) on a fresh stack of at least
+ * stack_size bytes. Stacks of 7/8 of a power of two, like STACK_SIZE, fit
+ * their block exactly. The process exits with the return value of fn.
+ * Returns the pid of the new process, or -1 on failure.
+ */
+int spawn(int (*fn)(word), word arg, word stack_size) {
+	return syscall(SPAWN, (word)fn, arg, stack_size);
+}
+
+/*
+ * Returns the cpu cycle count, for timing code. Wraps around every 2^32
+ * cycles.
+ */
+word cycles() {
+	return syscall(CYCLES, 0, 0, 0);
+}
+
+/*
+ * Returns the most bytes of its stack that the process belonging to pid has
+ * ever used, and puts the size of its stack in size unless size is NULL.
+ * Returns -1 if there is no such process.
+ */
+int stackuse(int pid, word *size) {
+	return syscall(STACKUSE, pid, (word)size, 0);
+}
+
+/*
+ * Get a new region of ram of at least size bytes for a heap. See tlsf.c for
+ * an allocator that uses it. Returns the address of the region, or NULL on
+ * failure.
+ */
+void *sbrk(word size) {
+	return (void *)syscall(SBRK, size, 0, 0);
+}
+
+/*
+ * Create a shared memory segment of at least size bytes, filled with 0. The
+ * caller is attached to it. Returns the id of the segment, or -1 on failure.
+ */
+int shm_create(word size) {
+	return syscall(SHMCREATE, size, 0, 0);
+}
+
+/*
+ * Get access to the shared memory segment id. A process can have
+ * MPU_SHMREGIONS segments attached at once. Returns the address of the
+ * segment, or NULL on failure.
+ */
+void *shm_attach(int id) {
+	return (void *)syscall(SHMATTACH, id, 0, 0);
+}
+
+/*
+ * Give up access to the shared memory segment id. It is freed when no
+ * process is attached anymore. Returns 0 on success, -1 on failure.
+ */
+int shm_detach(int id) {
+	return syscall(SHMDETACH, id, 0, 0);
+}
+
+/*
+ * Put how much ram the kernel uses and how much is free in info, and what
+ * the process belonging to pid uses unless pid is ANYPID. Returns 0 on
+ * success, -1 if there is no such process.
+ */
+int meminfo(int pid, struct meminfo *info) {
+	return syscall(MEMINFO, pid, (word)info, 0);
+}
+
+/*
+ * Create a message queue that holds nslots messages of msgsize bytes each.
+ * Returns the id of the queue, or -1 on failure.
+ */
+int mq_create(word msgsize, word nslots) {
+	return syscall(MQCREATE, msgsize, nslots, 0);
+}
+
+/*
+ * Destroy the message queue id. Returns 0 on success, -1 on failure.
+ */
+int mq_destroy(int id) {
+	return syscall(MQDESTROY, id, 0, 0);
+}
+
+/*
+ * Send the message at msg to the queue id, waiting up to timeout ms if it
+ * is full. A timeout of 0 doesn't wait, WAIT_FOREVER waits as long as it
+ * takes. Returns 0 on success, TIMEDOUT if there was no room in time, or -1
+ * on failure.
+ */
+int mq_send(int id, void *msg, word timeout) {
+	return syscall(MQSEND, id, (word)msg, timeout);
+}
+
+/*
+ * Receive a message from the queue id into buf, waiting up to timeout ms if
+ * it is empty. Returns the size of the message, TIMEDOUT if none came in
+ * time, or -1 on failure.
+ */
+int mq_recv(int id, void *buf, word timeout) {
+	return syscall(MQRECV, id, (word)buf, timeout);
+}
+
+/*
+ * Send the size bytes at msg to the process belonging to pid, and wait for
+ * it to receive and reply. The reply is written over msg, up to size bytes.
+ * Returns the number of bytes in the reply, or -1 on failure.
+ */
+int send(int pid, void *msg, word size) {
+	return syscall(SEND, pid, (word)msg, size);
+}
+
+/*
+ * Wait for a message and receive it into buf, up to size bytes. Returns the
+ * pid of the sender, which waits until it gets a reply.
+ */
+int receive(void *buf, word size) {
+	return syscall(RECEIVE, (word)buf, size, 0);
+}
+
+/*
+ * Reply with the size bytes at msg to the process belonging to pid, whose
+ * message was received. Returns 0 on success, -1 on failure.
+ */
+int reply(int pid, void *msg, word size) {
+	return syscall(REPLY, pid, (word)msg, size);
+}
+
+/*
+ * Wait up to timeout ms for the ring r to have an item. Only the consumer of
+ * the ring may wait on it. Returns 0 when it has one, TIMEDOUT, or -1 on
+ * failure.
+ */
+int ring_wait(struct ring *r, word timeout) {
+	return syscall(RINGWAIT, (word)r, timeout, 0);
+}
+
+/*
+ * Wake up the consumer of the ring r if it is waiting in ring_wait(). Only
+ * needs to be called when ring_put() returns 1. Returns 0.
+ */
+int ring_wake(struct ring *r) {
+	return syscall(RINGWAKE, (word)r, 0, 0);
+}
+
+/*
+ * Create a semaphore with count units. Returns its id, or -1 on failure.
+ */
+int sem_create(word count) {
+	return syscall(SEMCREATE, count, 0, 0);
+}
+
+/*
+ * Destroy the semaphore id. Returns 0 on success, or -1 if there is no such
+ * semaphore or processes are blocked on it.
+ */
+int sem_destroy(int id) {
+	return syscall(SEMDESTROY, id, 0, 0);
+}
+
+/*
+ * Take a unit from the semaphore id, blocking until there is one. Only
+ * enters the kernel when there isn't one. Returns 0 on success, -1 on
+ * failure.
+ */
+int sem_wait(int id) {
+	volatile word *sem;
+	word count;
+	if(id < 0 || id >= NSEM) {
+		return -1;
+	}
+	sem = &syncpage->sem[id];
+	while((count = *sem) > 0 && count < SEM_WAITERS) {
+		if(cas(sem, count, count - 1)) {
+			return 0;
+		}
+	}
+	return syscall(SEMWAIT, id, 0, 0);
+}
+
+/*
+ * Give a unit to the semaphore id. Only enters the kernel when a process is
+ * blocked on it. Returns 0 on success, -1 on failure.
+ */
+int sem_post(int id) {
+	volatile word *sem;
+	word count;
+	if(id < 0 || id >= NSEM) {
+		return -1;
+	}
+	sem = &syncpage->sem[id];
+	while((count = *sem) < SEM_WAITERS - 1) {
+		if(cas(sem, count, count + 1)) {
+			return 0;
+		}
+	}
+	return syscall(SEMPOST, id, 0, 0);
+}
+
+/*
+ * Create an unlocked mutex. Returns its id, or -1 on failure.
+ */
+int mutex_create() {
+	return syscall(MUTEXCREATE, 0, 0, 0);
+}
+
+/*
+ * Destroy the mutex id. Returns 0 on success, or -1 if there is no such
+ * mutex or it is locked.
+ */
+int mutex_destroy(int id) {
+	return syscall(MUTEXDESTROY, id, 0, 0);
+}
+
+/*
+ * Lock the mutex id, blocking until it is unlocked. Only enters the kernel
+ * when it is locked. Returns 0 on success, -1 on failure.
+ */
+int mutex_lock(int id) {
+	if(id < 0 || id >= NMUTEX) {
+		return -1;
+	}
+	if(cas(&syncpage->mutex[id], 0, syncpage->pid + 1)) {
+		return 0;
+	}
+	return syscall(MUTEXLOCK, id, 0, 0);
+}
+
+/*
+ * Unlock the mutex id. Only enters the kernel when a process is blocked on
+ * it. Returns 0 on success, -1 on failure.
+ */
+int mutex_unlock(int id) {
+	if(id < 0 || id >= NMUTEX) {
+		return -1;
+	}
+	if(cas(&syncpage->mutex[id], syncpage->pid + 1, 0)) {
+		return 0;
+	}
+	return syscall(MUTEXUNLOCK, id, 0, 0);
+}
+
+/*
+ * Block until futex_wake() is called for addr, if addr still holds
+ * expected. Returns 0 when woken up, or -1 if addr didn't hold expected.
+ */
+int futex_wait(volatile word *addr, word expected) {
+	return syscall(FUTEXWAIT, (word)addr, expected, 0);
+}
+
+/*
+ * Wake up to n of the processes blocked in futex_wait() on addr. Returns the
+ * number that were woken up.
+ */
+int futex_wake(volatile word *addr, int n) {
+	return syscall(FUTEXWAKE, (word)addr, n, 0);
+}
+
+/*
+ * Set bits in the notification word of the process belonging to pid, waking
+ * it up if it is waiting for them. Returns 0 on success, -1 on failure.
+ */
+int notify(int pid, word bits) {
+	return syscall(NOTIFY, pid, bits, 0);
+}
+
+/*
+ * Wait up to timeout ms for any of the bits in mask to be set in the
+ * notification word, or all of them if mask has WAIT_ALL. Returns the bits
+ * of mask that were set, which are cleared, TIMEDOUT, or -1 if mask has no
+ * bits.
+ */
+int wait_bits(word mask, word timeout) {
+	return syscall(WAITBITS, mask, timeout, 0);
+}
+
+/*
+ * Create a pipe. fds[0] becomes a file descriptor for reading from it and
+ * fds[1] one for writing to it. Children made with fork() share them.
+ * Returns 0 on success, -1 on failure.
+ */
+int pipe(int fds[2]) {
+	return syscall(PIPE, (word)fds, 0, 0);
+}
+
+/*
+ * Read up to size bytes from fd into buf, waiting until there is at least
+ * one. Returns the number of bytes read, 0 at the end of a pipe whose write
+ * end has been closed everywhere, or -1 on failure.
+ */
+int read(int fd, void *buf, word size) {
+	return syscall(READ, fd, (word)buf, size);
+}
+
+/*
+ * Write up to size bytes from buf to fd, waiting while the pipe is full.
+ * Returns the number of bytes written, which may be less than size, or -1
+ * on failure or if the read end of the pipe has been closed everywhere.
+ */
+int write(int fd, void *buf, word size) {
+	return syscall(WRITE, fd, (word)buf, size);
+}
+
+/*
+ * Close fd. Returns 0 on success, -1 on failure.
+ */
+int close(int fd) {
+	return syscall(CLOSE, fd, 0, 0);
+}
+
+/* Store val at addr and return what was there, in one atomic step. */
+static word swap(volatile word *addr, word val) {
+	word old;
+	do {
+		old = *addr;
+	} while(!cas(addr, old, val));
+	return old;
+}
+
+/*
+ * Make m an unlocked mutex.
+ */
+void umutex_init(struct umutex *m) {
+	m->state = 0;
+}
+
+/*
+ * Lock m, blocking in futex_wait() until it is unlocked. Only enters the
+ * kernel when it is locked. Unlike mutex_lock(), the owner doesn't inherit
+ * the priority of processes waiting for it.
+ */
+void umutex_lock(struct umutex *m) {
+	word state;
+	if(cas(&m->state, 0, 1)) {
+		return;
+	}
+/* Mark it as waited on, so that the owner wakes us when it unlocks it. */
+	state = m->state;
+	if(2 != state) {
+		state = swap(&m->state, 2);
+	}
+	while(0 != state) {
+		futex_wait(&m->state, 2);
+		state = swap(&m->state, 2);
+	}
+}
+
+/*
+ * Unlock m. Only enters the kernel when someone may be waiting for it.
+ */
+void umutex_unlock(struct umutex *m) {
+	if(2 == swap(&m->state, 0)) {
+		futex_wake(&m->state, 1);
+	}
 }
 
 int exit(int exitcode) {
-	syscall1(EXIT, currproc(), &exitcode);
-/* Wait to be scheduled. This is done because the scheduler can't be called */
-/* from unprivledge mode since swtch uses msr instructions. */
+	syscall(EXIT, exitcode, 0, 0);
+/* The kernel switches away from an exited process for good, so the system */
+/* call never returns. */
 	while(1);
 }
 
@@ -0,0 +1,153 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : kheap_test.c                                                    *
+ * Synopsis : Host stress test for kmalloc() and kfree() in mem.c.            *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+/* Included so that the pools and the break can be checked. Only what the */
+/* test uses is linked, so none of the hardware is touched. */
+#include "../mem.c"
+
+/* Same size as KHEAP_SIZE in link.ld. */
+#define KTEST_HEAP 0x800
+/* Most blocks the test keeps track of, one for each of the smallest and one */
+/* more that kmalloc() has to refuse. */
+#define KTEST_BLOCKS (KTEST_HEAP / KMALLOC_MIN + 1)
+
+/* The kernel heap that the linker script would make. */
+__asm__(".pushsection .bss\n"
+        ".balign 16\n"
+        ".globl _heap\n"
+        "_heap:\n"
+        ".space 0x800\n"
+        ".globl _eheap\n"
+        "_eheap:\n"
+        ".space 16\n"
+        ".popsection\n");
+
+static void *ktestblocks[KTEST_BLOCKS];
+static int failures;
+
+/* Next number from a xorshift generator with the state x. */
+static word xorshift(word *x) {
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x & 0xFFFFFFFF;
+}
+
+/*
+ * Fill the first n test blocks of size bytes with their index, and check
+ * that each one is inside the kernel heap and that none of them were
+ * overwritten by another. Returns 0 if they are all intact, -1 otherwise.
+ */
+static int ktestfill(int n, word size) {
+	int k;
+	word j;
+	for(k = 0; k < n; k++) {
+		if((word)ktestblocks[k] < (word)&_heap ||
+		   (word)ktestblocks[k] + size > (word)&_eheap) {
+			return -1;
+		}
+		memset(ktestblocks[k], k, size);
+	}
+	for(k = 0; k < n; k++) {
+		for(j = 0; j < size; j++) {
+			if((k & 0xFF) != ((unsigned char *)ktestblocks[k])[j]) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void fail(const char *what, word size) {
+	printf("kheap_test failed: %s for %lu byte blocks\n", what, size);
+	failures++;
+}
+
+/*
+ * Each pool in turn gets the whole heap, which is filled with its blocks
+ * until kmalloc() fails. The blocks are freed in a random order and
+ * allocated again, which has to reuse them without cutting any more of the
+ * heap. The pool counters and the blocks are checked after each step.
+ */
+static void pools() {
+	struct kpool *pool;
+	void *tmp;
+	word x = 0x2545F491, used;
+	int i, k, n, j;
+	for(i = 0; i < KMALLOC_POOLS; i++) {
+		init_kheap();
+		pool = kpools + i;
+		for(n = 0; n < KTEST_BLOCKS; n++) {
+			if(NULL == (ktestblocks[n] = kmalloc(pool->size))) {
+				break;
+			}
+		}
+		used = kbrk;
+		if(n != KTEST_HEAP / pool->size || n != pool->inuse ||
+		   n != pool->allocs || 1 != pool->fails) {
+			fail("filling the heap", pool->size);
+			continue;
+		}
+		if(-1 == ktestfill(n, pool->size)) {
+			fail("overlapping blocks", pool->size);
+			continue;
+		}
+		for(k = n - 1; k > 0; k--) {
+			j = xorshift(&x) % (k + 1);
+			tmp = ktestblocks[k];
+			ktestblocks[k] = ktestblocks[j];
+			ktestblocks[j] = tmp;
+		}
+		for(k = 0; k < n; k++) {
+			kfree(ktestblocks[k], pool->size);
+		}
+		if(0 != pool->inuse) {
+			fail("freeing", pool->size);
+			continue;
+		}
+		for(k = 0; k < n; k++) {
+			if(NULL == (ktestblocks[k] = kmalloc(pool->size))) {
+				break;
+			}
+		}
+		if(k != n || NULL != kmalloc(pool->size) || used != kbrk ||
+		   n != pool->inuse || 2*n != pool->allocs || 2 != pool->fails) {
+			fail("reusing freed blocks", pool->size);
+			continue;
+		}
+		if(-1 == ktestfill(n, pool->size)) {
+			fail("overlapping reused blocks", pool->size);
+		}
+	}
+}
+
+/*
+ * Sizes between two pools come from the bigger one, and sizes no pool has
+ * fail without counting against any pool.
+ */
+static void sizes() {
+	word size;
+	init_kheap();
+	for(size = 1; size <= KMALLOC_MAX; size++) {
+		if(NULL == kmalloc(size) || 1 != kpools[kpool(size)].inuse ||
+		   kpools[kpool(size)].size < size ||
+		   (kpool(size) > 0 && kpools[kpool(size) - 1].size >= size)) {
+			fail("picking the pool", size);
+			return;
+		}
+		init_kheap();
+	}
+	if(NULL != kmalloc(0) || NULL != kmalloc(KMALLOC_MAX + 1) ||
+	   (word)&_heap != kbrk) {
+		fail("rejecting sizes", KMALLOC_MAX + 1);
+	}
+}
+
+int main() {
+	pools();
+	sizes();
+	return 0 == failures ? 0 : 1;
+}
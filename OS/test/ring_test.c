@@ -0,0 +1,123 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : ring_test.c                                                     *
+ * Synopsis : Host unit test for ring.c. A producer and a consumer thread     *
+ *            pass sequence numbers through a ring for many laps, so that     *
+ *            reordering or a race at the wrap point shows up on a multicore  *
+ *            host.                                                           *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "../ring.c"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+/* Size of the ring, and the items passed through it in each run. */
+#define RINGTEST_SIZE 64
+#define RINGTEST_ITEMS (1 << 22)
+
+static word ringmem[RING_BYTES(RINGTEST_SIZE) / sizeof(word)];
+static struct ring *r = (struct ring *)ringmem;
+/* Index the ring starts at, so that a run can start just before the */
+/* indices wrap around. */
+static word start;
+static int failures;
+/* Set when the consumer gives up, so that the producer doesn't wait on a */
+/* full ring forever. */
+static volatile int stop;
+
+/* The ring is shared by two threads, so the barrier has to order memory */
+/* between cores as well as stop the compiler. */
+void barrier() {
+	__sync_synchronize();
+}
+
+/*
+ * Puts the sequence numbers start to start + RINGTEST_ITEMS in the ring,
+ * checking that it never reports more than RINGTEST_SIZE items.
+ */
+static void *producer(void *arg) {
+	word i;
+	int n;
+	for(i = start; i != start + RINGTEST_ITEMS; i++) {
+		while(-1 == (n = ring_put(r, i))) {
+			if(stop) {
+				return NULL;
+			}
+			sched_yield();
+		}
+		if(n < 1 || n > RINGTEST_SIZE) {
+			printf("ring_test failed: ring_put() returned %i\n", n);
+			failures++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Takes RINGTEST_ITEMS items from the ring while producer() puts them, and
+ * checks that every sequence number comes out once and in order.
+ */
+static void run(word first) {
+	pthread_t thread;
+	word i, item;
+	ring_init(r, RINGTEST_SIZE);
+	r->head = r->tail = start = first;
+	stop = 0;
+	pthread_create(&thread, NULL, producer, NULL);
+	for(i = start; i != start + RINGTEST_ITEMS; i++) {
+		while(-1 == ring_get(r, &item)) {
+			sched_yield();
+		}
+		if(item != i) {
+			printf("ring_test failed: got %lu, not %lu\n", item, i);
+			failures++;
+			stop = 1;
+			break;
+		}
+	}
+	pthread_join(thread, NULL);
+	if(0 == failures && (r->head != i || r->tail != i || 0 != ring_count(r))) {
+		printf("ring_test failed: ring not empty at the end\n");
+		failures++;
+	}
+}
+
+/*
+ * A ring holds exactly its size, and is empty once that many are taken.
+ */
+static void bounds() {
+	word i, item;
+	ring_init(r, RINGTEST_SIZE);
+	for(i = 0; i < RINGTEST_SIZE; i++) {
+		if(i + 1 != ring_put(r, i)) {
+			printf("ring_test failed: put %lu into an empty ring\n", i);
+			failures++;
+			return;
+		}
+	}
+	if(-1 != ring_put(r, i) || RINGTEST_SIZE != ring_count(r)) {
+		printf("ring_test failed: put into a full ring\n");
+		failures++;
+	}
+	for(i = 0; i < RINGTEST_SIZE; i++) {
+		if(-1 == ring_get(r, &item) || item != i) {
+			printf("ring_test failed: took %lu from a full ring\n", i);
+			failures++;
+			return;
+		}
+	}
+	if(-1 != ring_get(r, &item)) {
+		printf("ring_test failed: took from an empty ring\n");
+		failures++;
+	}
+}
+
+int main() {
+	bounds();
+	run(0);
+/* Half of the run is on either side of the indices wrapping around. */
+	run((word)0 - RINGTEST_ITEMS / 2);
+	return 0 == failures ? 0 : 1;
+}
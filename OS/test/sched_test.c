@@ -0,0 +1,166 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : sched_test.c                                                    *
+ * Synopsis : Host unit test for the ready bitmaps in proc.c. Checks the      *
+ *            exact order processes are picked in against a scan of ptable    *
+ *            like the one the scheduler used to do.                          *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+/* Included so that the static functions can be tested. Only what the test */
+/* uses is linked, so none of the hardware is touched. */
+#include "../proc.c"
+
+/* Number of random state changes compared against the scan. */
+#define SCHEDTEST_STEPS 100000
+
+/* 1 for the processes that are ready, kept by the test. */
+static int ready[MAX_PROC];
+static int failures;
+
+/* Next number from a xorshift generator with the state x. */
+static word xorshift(word *x) {
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x & 0xFFFFFFFF;
+}
+
+/*
+ * The pick of the old scheduler, which walked ptable one slot at a time
+ * from the slot after the last process that ran, wrapping around to 0, and
+ * took the first one that was ready. The highest priority level with
+ * anything ready is found first. Returns -1 if nothing is ready.
+ */
+static int scanpick(int last) {
+	int pid, i, top = -1;
+	for(pid = 0; pid < MAX_PROC; pid++) {
+		if(ready[pid] && ptable[pid].priority > top) {
+			top = ptable[pid].priority;
+		}
+	}
+	for(i = 1; i <= MAX_PROC; i++) {
+		pid = (last + i) % MAX_PROC;
+		if(ready[pid] && ptable[pid].priority == top) {
+			return pid;
+		}
+	}
+	return -1;
+}
+
+static void setready(int pid) {
+	ready[pid] = 1;
+	enqueue(ptable + pid);
+}
+
+static void setwaiting(int pid) {
+	ready[pid] = 0;
+	dequeue(ptable + pid);
+}
+
+/*
+ * Check that the next count picks after last are the pids in want, and
+ * leave currpid at the last one.
+ */
+static void expect(const char *what, int last, const int *want, int count) {
+	int i, pid;
+	for(i = 0; i < count; i++) {
+		pid = nextready(last);
+		if(pid != want[i]) {
+			printf("sched_test failed: %s, pick %i was %i, not %i\n", \
+					what, i, pid, want[i]);
+			failures++;
+			return;
+		}
+		last = pid;
+	}
+	currpid = last;
+}
+
+/*
+ * Processes of equal priority take turns in pid order starting after the
+ * one that ran, a higher priority one runs alone until it stops being
+ * ready, and the others carry on where they left off.
+ */
+static void roundrobin() {
+	const int turns[] = {20, 3, 7, 8, 20, 3, 7, 8};
+	const int high[] = {12, 12, 12};
+	const int after[] = {20, 3, 7, 8};
+	const int without7[] = {8, 20, 3, 8, 20};
+	const int lowered[] = {3, 8, 3, 8};
+	const int last[] = {31, 31};
+	setready(3);
+	setready(7);
+	setready(8);
+	setready(20);
+	expect("equal priorities", 8, turns, 8);
+	ptable[12].priority = PRIO_DEFAULT + 1;
+	setready(12);
+	expect("higher priority", currpid, high, 3);
+	setwaiting(12);
+	expect("back to round robin", 8, after, 4);
+	setwaiting(7);
+	expect("one waiting", 7, without7, 5);
+	changepriority(ptable + 20, PRIO_DEFAULT - 1);
+	expect("one lowered", 20, lowered, 4);
+	setwaiting(3);
+	setwaiting(8);
+	setwaiting(20);
+	if(-1 != nextready(0)) {
+		printf("sched_test failed: picked a process when none were ready\n");
+		failures++;
+	}
+	ptable[31].priority = PRIO_MIN;
+	setready(31);
+	expect("only the last pid", 31, last, 2);
+	setwaiting(31);
+}
+
+/*
+ * Make random processes ready, waiting or change their priority, and check
+ * after each change that the bitmaps pick what the scan would have.
+ */
+static void randomsteps() {
+	word x = 0x2545F491;
+	int step, pid, want, got;
+	for(step = 0; step < SCHEDTEST_STEPS; step++) {
+		pid = xorshift(&x) % MAX_PROC;
+		switch(xorshift(&x) % 3) {
+			case 0:
+				if(!ready[pid]) {
+					setready(pid);
+				}
+				break;
+			case 1:
+				if(ready[pid]) {
+					setwaiting(pid);
+				}
+				break;
+			case 2:
+				changepriority(ptable + pid, xorshift(&x) % NPRIO);
+				break;
+		}
+		want = scanpick(currpid);
+		got = nextready(currpid);
+		if(want != got) {
+			printf("sched_test failed: step %i picked %i, the scan picked %i\n", \
+					step, got, want);
+			failures++;
+			return;
+		}
+		if(-1 != got) {
+			currpid = got;
+		}
+	}
+}
+
+int main() {
+	int i;
+	for(i = 0; i < MAX_PROC; i++) {
+		ptable[i].pid = i;
+		ptable[i].priority = PRIO_DEFAULT;
+		ptable[i].waitq = NULL;
+	}
+	roundrobin();
+	randomsteps();
+	return 0 == failures ? 0 : 1;
+}
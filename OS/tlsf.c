@@ -0,0 +1,218 @@
+/******************************************************************************
+ * Authour  : Ben Haubrich                                                    *
+ * File     : tlsf.c                                                          *
+ * Synopsis : Two level segregated fit allocator for user heaps. Free blocks  *
+ *            are kept in lists by size, and bitmaps of the non-empty lists   *
+ *            find a block that fits with a couple of CLZ instructions, so    *
+ *            allocating and freeing take constant time.                      *
+ * Date     : October 17th, 2026                                              *
+ *****************************************************************************/
+#include <types.h>
+#include <syscalls.h> /* For sbrk() */
+#include <mem.h> /* For ramsize() */
+#include <tlsf.h>
+
+/* Size of the part of a block header that is there when the block is used. */
+#define HDR_SIZE (2*sizeof(word))
+/* The smallest block has room for the links of a free block. */
+#define BLOCK_MIN (sizeof(struct hblock) - HDR_SIZE)
+#define FREE 0x1
+
+#define bsize(b) ((b)->size & ~FREE)
+#define isfree(b) ((b)->size & FREE)
+/* Block that comes right after b in memory. */
+#define nextphys(b) ((struct hblock *)((word)(b) + HDR_SIZE + bsize(b)))
+
+/* Index of the highest set bit. x must not be 0. */
+static int highbit(word x) {
+	return 31 - __builtin_clz(x);
+}
+
+/* Index of the lowest set bit. x must not be 0. */
+static int lowbit(word x) {
+	return __builtin_ctz(x);
+}
+
+/* The lists that free blocks of size bytes are kept in. */
+static void mapping(word size, int *fl, int *sl) {
+	int f;
+	if(size < HEAP_SMALL) {
+		*fl = 0;
+		*sl = size / (HEAP_SMALL / SL_COUNT);
+	}
+	else {
+		f = highbit(size);
+		*sl = (size >> (f - SL_LOG2)) ^ SL_COUNT;
+		*fl = f - FL_SHIFT + 1;
+	}
+}
+
+/*
+ * Find a free block of at least size bytes. The size is rounded up to the
+ * next list first, so that any block in that list or a later one is big
+ * enough. Returns NULL if there is none.
+ */
+static struct hblock *search(struct heap *h, word size) {
+	int fl, sl;
+	word map;
+	if(size >= HEAP_SMALL) {
+		size += (1 << (highbit(size) - SL_LOG2)) - 1;
+	}
+	mapping(size, &fl, &sl);
+	if(fl >= FL_COUNT) {
+		return NULL;
+	}
+	map = h->slmap[fl] & (~0u << sl);
+	if(0 == map) {
+/* Nothing left at this power of two. Take the smallest bigger one. */
+		if(fl + 1 >= FL_COUNT || 0 == (map = h->flmap & (~0u << (fl + 1)))) {
+			return NULL;
+		}
+		fl = lowbit(map);
+		map = h->slmap[fl];
+	}
+	return h->free[fl][lowbit(map)];
+}
+
+static void insert(struct heap *h, struct hblock *b) {
+	int fl, sl;
+	mapping(bsize(b), &fl, &sl);
+	b->prev = NULL;
+	b->next = h->free[fl][sl];
+	if(NULL != b->next) {
+		b->next->prev = b;
+	}
+	h->free[fl][sl] = b;
+	h->slmap[fl] |= 1u << sl;
+	h->flmap |= 1u << fl;
+	b->size |= FREE;
+}
+
+static void takeout(struct heap *h, struct hblock *b) {
+	int fl, sl;
+	mapping(bsize(b), &fl, &sl);
+	if(NULL != b->prev) {
+		b->prev->next = b->next;
+	}
+	else if(NULL == (h->free[fl][sl] = b->next)) {
+		h->slmap[fl] &= ~(1u << sl);
+		if(0 == h->slmap[fl]) {
+			h->flmap &= ~(1u << fl);
+		}
+	}
+	if(NULL != b->next) {
+		b->next->prev = b->prev;
+	}
+	b->size &= ~FREE;
+}
+
+/*
+ * Make the size bytes at addr one big free block. It ends with a header
+ * that is never free, so blocks are never merged past the end of the region.
+ */
+static void addpool(struct heap *h, word addr, word size) {
+	struct hblock *b = (struct hblock *)addr;
+	struct hblock *end;
+	b->prevphys = NULL;
+	b->size = (size - 2*HDR_SIZE) & ~(HEAP_ALIGN - 1);
+	end = nextphys(b);
+	end->prevphys = b;
+	end->size = 0;
+	insert(h, b);
+}
+
+/*
+ * Create a heap with room for at least size bytes of blocks. sbrk() rounds
+ * regions up the same way as ramsize(), and all of the region goes to the
+ * heap. Returns the heap, or NULL if the kernel wouldn't grant the ram.
+ */
+struct heap *heap_init(word size) {
+	int i, j;
+	word pool;
+	word granted = ramsize(sizeof(struct heap) + HEAP_ALIGN + 2*HDR_SIZE + size);
+	struct heap *h = sbrk(granted);
+	if(NULL == h) {
+		return NULL;
+	}
+	h->flmap = 0;
+	for(i = 0; i < FL_COUNT; i++) {
+		h->slmap[i] = 0;
+		for(j = 0; j < SL_COUNT; j++) {
+			h->free[i][j] = NULL;
+		}
+	}
+/* The blocks go after the heap state. */
+	pool = ((word)(h + 1) + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+	addpool(h, pool, (word)h + granted - pool);
+	return h;
+}
+
+/*
+ * Add another region of ram with room for at least size bytes to the heap.
+ * Returns 0 on success, -1 if the kernel wouldn't grant the ram.
+ */
+int heap_grow(struct heap *h, word size) {
+	word granted = ramsize(2*HDR_SIZE + size);
+	void *addr = sbrk(granted);
+	if(NULL == addr) {
+		return -1;
+	}
+	addpool(h, (word)addr, granted);
+	return 0;
+}
+
+/*
+ * Allocate size bytes from the heap h. Takes constant time. Returns the
+ * address of the memory, or NULL if there is no free block big enough.
+ */
+void *heap_alloc(struct heap *h, word size) {
+	struct hblock *b, *rest;
+/* No block is that big, and rounding it up could wrap around to 0. */
+	if(0 == size || size >= (1u << FL_MAX)) {
+		return NULL;
+	}
+	size = (size + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+	if(size < BLOCK_MIN) {
+		size = BLOCK_MIN;
+	}
+	if(NULL == (b = search(h, size))) {
+		return NULL;
+	}
+	takeout(h, b);
+/* Give back what isn't needed if it's big enough to be a block. */
+	if(bsize(b) >= size + sizeof(struct hblock)) {
+		rest = (struct hblock *)((word)b + HDR_SIZE + size);
+		rest->size = bsize(b) - size - HDR_SIZE;
+		rest->prevphys = b;
+		nextphys(rest)->prevphys = rest;
+		b->size = size;
+		insert(h, rest);
+	}
+	return (void *)((word)b + HDR_SIZE);
+}
+
+/*
+ * Give the memory at addr back to the heap h. It is merged with the blocks
+ * on either side of it if they are free. Takes constant time.
+ */
+void heap_free(struct heap *h, void *addr) {
+	struct hblock *b, *next, *prev;
+	if(NULL == addr) {
+		return;
+	}
+	b = (struct hblock *)((word)addr - HDR_SIZE);
+	next = nextphys(b);
+	if(isfree(next)) {
+		takeout(h, next);
+		b->size += HDR_SIZE + next->size;
+		nextphys(b)->prevphys = b;
+	}
+	prev = b->prevphys;
+	if(NULL != prev && isfree(prev)) {
+		takeout(h, prev);
+		prev->size += HDR_SIZE + b->size;
+		nextphys(prev)->prevphys = prev;
+		b = prev;
+	}
+	insert(h, b);
+}
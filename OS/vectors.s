@@ -26,8 +26,6 @@ STACK_TOP:
 	.global Reset_EXCP
 /* processor_state is externed in handlers.c for svc calls. */
 	.global processor_state
-/* A way to dance around and deal with exception mechanisms */
-	.global kernel_entry
 
 	.section .intvecs
 
@@ -62,19 +60,22 @@ Vectors:
 	.type Reset_EXCP, %function
 Reset_EXCP: .fnstart
 /* Calculate how much ram the kernel is using so we know where to start */
-/* allocating ram pages for user programs. See get_stackspace(). */
+/* allocating ram for user programs. See init_ram(). */
 /* Where ever the top of stack is determines how much space the kernel is */
 /* using. The end of the kernel is the stack top because of how the linker */
 /* arranges data storage in SRAM. */
-						mov r0, #0x400 /* Stack Size */
+						mov r0, #0x80 /* RAM_GRAIN */
 						mov r1, sp
 						sub r1, r1, #0x20000000
-/* Divide this by the current position of the sp to get an integer for */
-/* get_stackspace. */
+/* Divide the current position of the sp by the granule size to get the */
+/* number of granules the kernel is using. */
 						udiv r1, r0
 /* Push the value onto the first spot in the stack marked by the symbol */
 /* KRAM_USAGE. */
 						push {r1}
+/* No process has run yet, so there is no process stack for swtch to save. */
+						mov r0, #0
+						msr psp, r0
 /* Enable the FPU. Taken from tivaware bootloader code, but also detailed */
 /* on page 74 of the Cortext-M4 TRM. It is enabling bits within the register */
 /* located at 0xE000ED88. */
@@ -101,6 +102,7 @@ HFAULT: .fnstart
 	.align 2
 	.type MM_FAULT, %function
 MM_FAULT: .fnstart
+					mov r0, lr
 					b mm_handler
 					.fnend
 
@@ -144,11 +146,33 @@ UUser:
 				b u_handler
 				.fnend
 
+/*
+ * The processor has stacked r0-r3, r12, lr, pc and xpsr on the process stack.
+ * Push the rest of the registers onto the kernel stack in the same layout as
+ * a struct context (see proc.h) so that fork can give the child a copy of
+ * them. svc_handler(struct trapframe *, struct context *) gets the sysnum and
+ * arguments from r0-r3 in the trapframe and puts the return value in r0.
+ * The extra word keeps the kernel stack 8 byte aligned.
+ */
 	.align 2
 	.type SVC_EXCP, %function
 SVC_EXCP: .fnstart
-				 b svc_handler
-				 .fnend
+					sub sp, sp, #4
+/* Bit 4 of EXC_RETURN is clear when the fpu registers were stacked too. */
+					tst lr, #0x10
+					it eq
+					vpusheq {s16-s31}
+					push {r4-r11, lr}
+					mrs r0, psp
+					mov r1, sp
+					bl svc_handler
+					pop {r4-r11, lr}
+					tst lr, #0x10
+					it eq
+					vpopeq {s16-s31}
+					add sp, sp, #4
+					bx lr
+					.fnend
 
 	.align 2
 	.type DM_EXCP, %function
@@ -156,84 +180,19 @@ DM_EXCP: .fnstart
 				b dm_handler
 				.fnend
 
+/* The context switcher. See context.s */
 	.align 2
 	.type PSV_EXCP, %function
 PSV_EXCP: .fnstart
-				 b psv_handler
+				 b swtch
 				 .fnend
 
-/*
- * The reason we don't do a direct branch to the handler is to avoid context
- * switching while in handler mode. The processor's exception mechanism makes
- * switching in handler mode very difficult. The exception mechanism exits
- * handler mode on the bx lr, and stack saving happens in kernel_entry. The
- * purpose of this code here is too save r0, pc and lr because it will be
- * changed when we enter the exeption handler c code. kernel_entry will need
- * these values in order to save the context correclty.
- */
 	.align 2
 	.type SYST_EXCP, %function
 SYST_EXCP: .fnstart
-/* Get the processes stack pointer and save it */
-					mrs r0, psp
-/* Save the value of the exception stack r0. */
-					mov r4, r0
-/* Save the value of the exception stack pc. */
-					ldr r5, [r0, #24]
-/* Save the value of the exception stack lr. */
-					ldr r6, [r0, #20]
-/* Make sure r5 has bit one set for thumb instructions. */
-					ands r8, r5, #0x1
-					bne Thumb
-					add r5, r5, #0x1
-Thumb:
-					ldr r3,=syst_handler
-/* overwrite r0 on the stack for a function call. It will be returned in */
-/* kernel_entry(). */
-					str r0, [r4]
-/* Place syst_handler on the stacked pc. Exception mechanism retores it to lr*/
-					str r3, [r0, #24]
-/* Save r7 in case syst_handler changes it. */
-					mov r8, r7
-/* Exception return mechanism will return r0-r3 to pre-exception values. */
-/* r4, r5, and r6 remain unscathed. */
-/* Change thread mode privledge level to privledged. */
-					mrs r3, CONTROL
-					bic r3, r3, #0x1
-					msr CONTROL, r3
-					bx lr
+					b syst_handler
 					.fnend
 
-/*
- * Entry to the kernel from the systick isr. It is executed from thread
- * mode so that it is possible to save stacks and context switch properly.
- * It makes sure the process stack is returned to it's orginal state, and then
- * pushes the context onto the stack and saves the stack pointer (psp) before
- * switching stacks from psp to msp. The corresponding pop is made from swtch
- * so make sure that the push here and pop in swtch() are consistent.
- */
-	.align 2
-	.type kernel_entry, %function
-kernel_entry: .fnstart
-/* Transfer r0 to r9 so that r0 can be returned to it's saved pre-systick */
-/* interrupt value. */
-							mov r9, r0
-/* Return r0 to it's initial value */
-							mov r0, r4
-/* Save the lr before moving the saved pc from systick isr into it. */
-							mov r4, r14
-							mov r14, r6
-							push {r0-r3, r5, r7, r12, r14}
-/* Save the stack pointer to context struct */
-							str sp, [r9] 
-/* Switch stacks to msp and restore lr to it's original value */
-							mov r14, r4
-							mrs r3, CONTROL
-							bic r3, r3, #0x2
-							msr CONTROL, r3
-							bx lr
-							.fnend
-
 /* Change the processor state to either enable or disable interrupts. */
 /* use 1 as a parameter to enable, 0 to disable. */
 	.align 2